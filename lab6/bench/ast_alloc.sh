@@ -0,0 +1,34 @@
+#!/bin/bash
+# Heap allocations and run time at -O0 (parsing and type checking, the
+# generated programs do little) of this tree against REV, by default the
+# revision before AST nodes came from an arena.
+#   ./bench/ast_alloc.sh [REV]
+set -e
+cd "$(dirname "$0")/.."
+
+REV=${1:-$(git log --diff-filter=A --format=%H -- lib/arena.c | tail -1)~1}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+mkdir -p "$TMP/new" "$TMP/old"
+cp -r lib parser.y scanner.l makefile "$TMP/new"
+git archive "$REV" . | tar -x -C "$TMP/old"
+make -C "$TMP/new" compile > /dev/null
+make -C "$TMP/old" compile > /dev/null
+gcc -shared -fPIC bench/count_alloc.c -o "$TMP/count_alloc.so"
+
+# Allocations and seconds, "allocs secs"
+measure(){
+    local bin=$1 prog=$2 allocs secs
+    allocs=$(cd "$TMP" && LD_PRELOAD="$TMP/count_alloc.so" "$bin" -O0 "$prog" -i /dev/null 2>&1 > /dev/null | sed -n 's/^allocations: //p')
+    secs=$( { TIMEFORMAT=%R; time (cd "$TMP" && "$bin" -O0 "$prog" -i /dev/null > /dev/null); } 2>&1 )
+    echo "$allocs $secs"
+}
+
+printf "%10s %14s %14s %10s %10s\n" statements "allocs old" "allocs new" "secs old" "secs new"
+for n in 10000 100000 500000; do
+    ./bench/gen_program.sh $n > "$TMP/prog.ezl"
+    read old_allocs old_secs <<< "$(measure "$TMP/old/ezlang.bin" "$TMP/prog.ezl")"
+    read new_allocs new_secs <<< "$(measure "$TMP/new/ezlang.bin" "$TMP/prog.ezl")"
+    printf "%10s %14s %14s %10s %10s\n" $n $old_allocs $new_allocs $old_secs $new_secs
+done
@@ -0,0 +1,33 @@
+// LD_PRELOAD shim counting the heap allocations of a process (glibc only).
+//   gcc -shared -fPIC count_alloc.c -o count_alloc.so
+//   LD_PRELOAD=./count_alloc.so ./ezlang.bin ...
+// The count is written to stderr at exit.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static unsigned long allocs = 0;
+
+void* malloc(size_t size){
+    allocs++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size){
+    allocs++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size){
+    allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+__attribute__((destructor))
+static void report(){
+    fprintf(stderr, "allocations: %lu\n", allocs);
+}
@@ -0,0 +1,20 @@
+#!/bin/bash
+# Prints a straight EZLang program of N (default 10000) statements: chains
+# of arithmetic assignments over a few variables, with some writes and ifs.
+N=${1:-10000}
+awk -v n="$N" 'BEGIN {
+    srand(42);
+    split("a b c d e f g h", v, " ");
+    print "program generated;";
+    print "var";
+    for (i = 1; i <= 8; i++) print "    int " v[i] ";";
+    print "begin";
+    for (s = 0; s < n; s++) {
+        x = v[int(rand()*8)+1]; y = v[int(rand()*8)+1]; z = v[int(rand()*8)+1];
+        k = int(rand()*100);
+        if (s % 50 == 0)      print "    write " x " + " k ";";
+        else if (s % 20 == 0) print "    if " y " < " k " then " x " := " z " - 1; else " x " := " y " + " k "; end";
+        else                  print "    " x " := (" y " + " k ") * " z " - " y " / 7;";
+    }
+    print "end";
+}'
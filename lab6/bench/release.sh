@@ -0,0 +1,66 @@
+#!/bin/bash
+# Run time of the checked build (make compile) against the release build
+# (make release: inlined AST accessors, no checks, -O2 with LTO) of this
+# tree, at -O0 so the interpreter runs every statement as written. The
+# straight programs mostly measure parsing, the loops the interpreter.
+#   ./bench/release.sh
+set -e
+cd "$(dirname "$0")/.."
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+mkdir -p "$TMP/debug" "$TMP/release"
+cp -r lib parser.y scanner.l makefile "$TMP/debug"
+cp -r lib parser.y scanner.l makefile "$TMP/release"
+make -C "$TMP/debug" compile > /dev/null
+make -C "$TMP/release" release > /dev/null
+
+# Nested counting loops, N outer iterations of 1000
+loops(){
+    cat << EOF
+program loops;
+var
+    int i;
+    int j;
+    int s;
+begin
+    i := 0;
+    s := 0;
+    repeat
+        j := 0;
+        repeat
+            if j < i then
+                s := s + i * j - s / 3;
+            else
+                s := s - j;
+            end
+            j := j + 1;
+        until j = 1000
+        i := i + 1;
+    until i = $1
+    write s;
+end
+EOF
+}
+
+secs(){
+    { TIMEFORMAT=%R; time (cd "$TMP" && "$1" -O0 "$2" -i /dev/null > /dev/null); } 2>&1
+}
+
+printf "%22s %10s %10s %8s\n" program "secs debug" "secs rel" speedup
+run(){
+    local debug release
+    debug=$(secs "$TMP/debug/ezlang.bin" "$TMP/prog.ezl")
+    release=$(secs "$TMP/release/ezlang.bin" "$TMP/prog.ezl")
+    printf "%22s %10s %10s %8s\n" "$1" $debug $release "$(awk -v d=$debug -v r=$release 'BEGIN { printf "%.2fx", d/r }')"
+}
+
+for n in 100000 500000; do
+    ./bench/gen_program.sh $n > "$TMP/prog.ezl"
+    run "$n statements"
+done
+for n in 1000 5000; do
+    loops $n > "$TMP/prog.ezl"
+    run "$n x 1000 loop"
+done
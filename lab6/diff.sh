@@ -1,13 +1,24 @@
 #!/bin/bash
+# Every program must give its expected output with the optimizer off (-O 0)
+# and at every level, so a pass that changes what a program does shows here.
 EXE=./ezlang.bin
 IN=in
 OUT=out
+LEVELS="0 1 2"
 for infile in `ls $IN/*.ezl`; do
     base=$(basename $infile)
     outfile=$OUT/${base/.ezl/.out}
-    if ($EXE < $infile | diff -w $outfile -) &> /dev/null; then
+    data=$IN/${base/.ezl/.in} # What the program reads, if it does
+    [ -f $data ] || data=/dev/null
+    failed=""
+    for level in $LEVELS; do
+        if ! ($EXE -O $level $infile -i $data | diff -w $outfile -) &> /dev/null; then
+            failed="$failed -O$level";
+        fi
+    done
+    if [ -z "$failed" ]; then
         echo "${infile} -> Perfeito";
     else
-        echo "${infile} -> Diferente";
+        echo "${infile} -> Diferente ($failed )";
     fi
-done
\ No newline at end of file
+done
@@ -0,0 +1,95 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Bump allocator
+// ----------------------------------------------------------------------------
+
+typedef struct chunk {
+    struct chunk* next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGN) char data[]; // malloc's alignment is at least as strict
+} Chunk;
+
+struct arena {
+    Chunk* chunks; // Current one first
+    size_t chunk_count;
+    size_t used;
+};
+
+static size_t align(size_t size){
+    return (size + ARENA_ALIGN-1) & ~(size_t) (ARENA_ALIGN-1);
+}
+
+static void add_chunk(Arena* arena, size_t size){
+    if(size < ARENA_CHUNK_SIZE) size = ARENA_CHUNK_SIZE;
+
+    Chunk* chunk = malloc(sizeof(Chunk) + size);
+    CHECK_PTR_MSG(chunk, "Could not allocate memory");
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->chunk_count++;
+}
+
+
+// Create
+Arena* new_arena(){
+    Arena* arena = malloc(sizeof(Arena));
+    CHECK_PTR_MSG(arena, "Could not allocate memory");
+    arena->chunks = NULL;
+    arena->chunk_count = 0;
+    arena->used = 0;
+    return arena;
+}
+
+void free_arena(Arena* arena){
+    if(!arena) return;
+    while(arena->chunks){
+        Chunk* next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    free(arena);
+}
+
+
+// Modify
+void* arena_alloc(Arena* arena, size_t size){
+    CHECK_PTR(arena);
+    size = align(size);
+
+    Chunk* chunk = arena->chunks;
+    if(!chunk || chunk->size - chunk->used < size){
+        add_chunk(arena, size);
+        chunk = arena->chunks;
+    }
+
+    void* ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->used += size;
+    return ptr;
+}
+
+char* arena_strdup(Arena* arena, char* str){
+    size_t size = strlen(str) + 1;
+    char* copy = arena_alloc(arena, size);
+    memcpy(copy, str, size);
+    return copy;
+}
+
+
+// Get
+size_t get_arena_chunks(Arena* arena){
+    CHECK_PTR(arena);
+    return arena->chunk_count;
+}
+
+size_t get_arena_used(Arena* arena){
+    CHECK_PTR(arena);
+    return arena->used;
+}
@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include "debug.h"
+
+// Bump allocator ------------------------------------
+// Hands memory out in order from large chunks, so an allocation is a pointer
+// increment. Nothing is freed on its own: free_arena releases everything at
+// once. Blocks bigger than a chunk get a chunk of their own.
+#define ARENA_CHUNK_SIZE (1 << 20)
+#define ARENA_ALIGN 16
+
+typedef struct arena Arena;
+
+// Create
+Arena* new_arena();
+void free_arena(Arena* arena);
+
+// Modify
+void* arena_alloc(Arena* arena, size_t size);
+char* arena_strdup(Arena* arena, char* str);
+
+// Get
+size_t get_arena_chunks(Arena* arena);
+size_t get_arena_used(Arena* arena);
+//----------------------------------------------------
+
+#endif // ARENA_H
@@ -3,33 +3,155 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "arena.h"
 #include "ast.h"
 
-struct ast {
-    int id;
-    NodeKind kind;
-    char* name;
-    int line;
-    Type type;
-    double data; // or address
-    struct ast** children;
-    int children_length;
-};
+int ast_id = 1; // 0 is no node
+
+// Blocks and names of the compilation, released by free_all_ast. The blocks
+// have an arena of their own, compact_ast replaces it.
+static Arena* arena = NULL;
+static Arena* block_arena = NULL;
+AST** ast_blocks = NULL;
+static int block_count = 0;
+
+int* ast_list_ids = NULL;
+static int list_ids_length = 0;
+static int list_ids_size = 0;
+
+static char** names = NULL; // names[0] is NULL
+static int name_count = 0;
+static int names_size = 0;
+static int* name_table = NULL; // Open addressing over names
+static int name_table_size = 0;
+
+// Hash-consing table, open addressing
+static AST** shared = NULL;
+static int shared_size = 0;
+static int shared_count = 0;
+
+static Arena* get_arena(){
+    if(!arena) arena = new_arena();
+    return arena;
+}
 
-int ast_id = 1;
+static Arena* get_block_arena(){
+    if(!block_arena) block_arena = new_arena();
+    return block_arena;
+}
+
+static AST* get_node(int id){
+    return &ast_blocks[id >> AST_BLOCK_SHIFT][id & (AST_BLOCK_SIZE-1)];
+}
+
+static int* get_children(AST* ast){
+    return ast->ranged ? &ast_list_ids[ast->children[0]] : ast->children;
+}
+
+static int get_room(int length){
+    int room = AST_LIST_MIN_SIZE;
+    while(room < length) room *= 2;
+    return room;
+}
+
+static void reserve_list_ids(int size){
+    if(size <= list_ids_size) return;
+    while(list_ids_size < size) list_ids_size = list_ids_size ? 2*list_ids_size : AST_BLOCK_SIZE;
+    ast_list_ids = realloc(ast_list_ids, list_ids_size*sizeof(int));
+    CHECK_PTR_MSG(ast_list_ids, "Could not reallocate memory");
+}
+
+// Makes room for one more child of a ranged node.
+static void grow_range(AST* ast){
+    int start = ast->children[0];
+    int length = ast->children[1];
+    if(length > 0 && length < get_room(length)) return;
+
+    int old_room = length > 0 ? get_room(length) : 0;
+    int room = get_room(length+1);
+    if(length > 0 && start + old_room == list_ids_length){ // Last range, grows in place
+        reserve_list_ids(start + room);
+    }
+    else{
+        reserve_list_ids(list_ids_length + room);
+        memcpy(&ast_list_ids[list_ids_length], &ast_list_ids[start], length*sizeof(int));
+        ast->children[0] = list_ids_length;
+    }
+    list_ids_length = ast->children[0] + room;
+}
+
+// Moves the children kept in the node to a range.
+static void make_ranged(AST* ast){
+    int length = ast->length;
+    reserve_list_ids(list_ids_length + get_room(length+1));
+    memcpy(&ast_list_ids[list_ids_length], ast->children, length*sizeof(int));
+
+    ast->children[0] = list_ids_length;
+    ast->children[1] = length;
+    ast->ranged = 1;
+    ast->length = 0;
+    list_ids_length += get_room(length+1);
+}
+
+static unsigned hash_str(char* str){
+    unsigned h = 2166136261u; // FNV-1a
+    for(; *str; str++) h = (h ^ (unsigned char) *str) * 16777619u;
+    return h;
+}
+
+static void insert_name(int name){
+    int i = hash_str(names[name]) & (name_table_size-1);
+    while(name_table[i]) i = (i+1) & (name_table_size-1);
+    name_table[i] = name;
+}
+
+static int intern_name(char* name){
+    if(name_count == 0) name_count = 1; // names[0] stays NULL
+
+    if(2*name_count >= name_table_size){
+        name_table_size = name_table_size ? 2*name_table_size : AST_NAMES_INITIAL_SIZE;
+        free(name_table);
+        name_table = calloc(name_table_size, sizeof(int));
+        CHECK_PTR_MSG(name_table, "Could not allocate memory");
+        for(int n=1; n<name_count; n++) insert_name(n);
+    }
+
+    int i = hash_str(name) & (name_table_size-1);
+    for(; name_table[i]; i = (i+1) & (name_table_size-1)){
+        if(!strcmp(names[name_table[i]], name)) return name_table[i];
+    }
+
+    if(name_count >= names_size){
+        names_size = names_size ? 2*names_size : AST_NAMES_INITIAL_SIZE;
+        names = realloc(names, names_size*sizeof(char*));
+        CHECK_PTR_MSG(names, "Could not reallocate memory");
+        names[0] = NULL;
+    }
+    names[name_count] = arena_strdup(get_arena(), name);
+    name_table[i] = name_count;
+    return name_count++;
+}
 
 // Create
 AST* new_ast(NodeKind kind, char* name, int line, Type type, double data) {
-    AST* new_ast = malloc(sizeof(AST));
-    new_ast->id = ast_id++;
+    int id = ast_id++;
+    if((id >> AST_BLOCK_SHIFT) == block_count){
+        ast_blocks = realloc(ast_blocks, (block_count+1)*sizeof(AST*));
+        CHECK_PTR_MSG(ast_blocks, "Could not reallocate memory");
+        ast_blocks[block_count++] = arena_alloc(get_block_arena(), AST_BLOCK_SIZE*sizeof(AST));
+    }
+
+    AST* new_ast = get_node(id);
+    new_ast->id = id;
     new_ast->kind = kind;
-    new_ast->name = NULL;
+    new_ast->name = 0;
     set_ast_name(new_ast, name);
     new_ast->line = line;
     new_ast->type = type;
-    new_ast->data = data;
-    new_ast->children = NULL;
-    new_ast->children_length = 0;
+    set_ast_data(new_ast, data);
+    new_ast->length = 0;
+    new_ast->ranged = kind == STMT_LIST_NODE || kind == VAR_DECL_LIST_NODE;
+    memset(new_ast->children, 0, sizeof(new_ast->children));
     return new_ast;
 }
 
@@ -47,11 +169,230 @@ AST* new_ast_subtree(NodeKind kind, char* name, int line, Type type, int child_c
     return parent;
 }
 
+AST* copy_ast(AST* ast){
+    if(!ast) return NULL;
+
+    AST* copy = new_ast(ast->kind, names ? names[ast->name] : NULL, ast->line, ast->type, get_ast_data(ast));
+    for (int i=0; i<get_ast_length(ast); i++) {
+        add_ast_child(copy, copy_ast(get_ast_child(ast, i)));
+    }
+    return copy;
+}
+
+// Hash-consing ---------------------------------------------------------------
+// Expressions have no side effects, so two structurally identical ones can
+// be the same node. A node is identical to another when it has the same kind,
+// type, data, name and the very same children (already shared, bottom-up).
+// The line is left out, except for an integer division, which reports it on
+// division by zero. Statements and declarations are never shared.
+//
+// A shared node belongs to every tree using it: it must not be modified, and
+// a pass rewriting expressions in place has to run before share_ast.
+
+static int is_pure(AST* ast){
+    switch((NodeKind) ast->kind){
+        case PROGRAM_NODE:
+        case VAR_DECL_LIST_NODE:
+        case VAR_DECL_NODE:
+        case STMT_LIST_NODE:
+        case IF_NODE:
+        case REPEAT_NODE:
+        case READ_NODE:
+        case WRITE_NODE:
+        case ASSIGN_NODE: return 0;
+        default:          return 1;
+    }
+}
+
+static int get_shared_line(AST* ast){
+    return ast->kind == OVER_NODE ? ast->line : 0;
+}
+
+static unsigned hash_ast(AST* ast){
+    unsigned h = 2166136261u; // FNV-1a
+    unsigned words[5] = {ast->kind, ast->type, ast->data.as_int, ast->name, get_shared_line(ast)};
+    for(int i=0; i<5; i++) h = (h ^ words[i]) * 16777619u;
+    int* children = get_children(ast);
+    for(int i=0; i<get_ast_length(ast); i++) h = (h ^ children[i]) * 16777619u;
+    return h;
+}
+
+static int is_same_node(AST* a, AST* b){
+    if(a->kind != b->kind || a->type != b->type || a->data.as_int != b->data.as_int) return 0;
+    if(get_shared_line(a) != get_shared_line(b) || get_ast_length(a) != get_ast_length(b) || a->name != b->name) return 0;
+    int* a_children = get_children(a);
+    int* b_children = get_children(b);
+    for(int i=0; i<get_ast_length(a); i++){
+        if(a_children[i] != b_children[i]) return 0;
+    }
+    return 1;
+}
+
+static void insert_shared(AST* ast){
+    int i = hash_ast(ast) & (shared_size-1);
+    while(shared[i]) i = (i+1) & (shared_size-1);
+    shared[i] = ast;
+    shared_count++;
+}
+
+// Returns the shared node identical to ast, ast itself when it is the first.
+static AST* intern_ast(AST* ast){
+    if(2*(shared_count+1) > shared_size){
+        AST** old = shared;
+        int old_size = shared_size;
+
+        shared_size = shared_size ? 2*shared_size : AST_SHARED_INITIAL_SIZE;
+        shared = calloc(shared_size, sizeof(AST*));
+        CHECK_PTR_MSG(shared, "Could not allocate memory");
+        shared_count = 0;
+        for(int i=0; i<old_size; i++){
+            if(old[i]) insert_shared(old[i]);
+        }
+        free(old);
+    }
+
+    int i = hash_ast(ast) & (shared_size-1);
+    for(; shared[i]; i = (i+1) & (shared_size-1)){
+        if(is_same_node(shared[i], ast)) return shared[i];
+    }
+    shared[i] = ast;
+    shared_count++;
+    return ast;
+}
+
+static AST* rec_share_ast(AST* ast){
+    if(!ast) return NULL;
+
+    for(int i=0; i<get_ast_length(ast); i++){
+        set_ast_child(ast, i, rec_share_ast(get_ast_child(ast, i)));
+    }
+    if(!is_pure(ast)) return ast;
+    return intern_ast(ast);
+}
+
+// Shares the expressions of a tree, then compacts the pool so the memory of
+// the duplicates dropped is given back.
+AST* share_ast(AST* ast){
+    if(!ast) return NULL;
+    ast = rec_share_ast(ast);
+    free_shared_ast(); // Its pointers go stale with the compaction
+    return compact_ast(ast);
+}
+
+
+// Compaction -----------------------------------------------------------------
+// The nodes reachable from the root are copied to new blocks, renumbered
+// from 1 in the order they are first reached, and the old blocks are freed
+// with their arena. Ranges are copied too, with the room their length needs.
+// Names stay where they are. Any pointer to a node kept outside the tree is
+// stale afterwards.
+
+static int number_live(AST* ast, int* new_ids, int count){
+    new_ids[ast->id] = ++count;
+    int* children = get_children(ast);
+    for(int i=0; i<get_ast_length(ast); i++){
+        if(!new_ids[children[i]]) count = number_live(get_node(children[i]), new_ids, count);
+    }
+    return count;
+}
+
+AST* compact_ast(AST* ast){
+    if(!ast) return NULL;
+
+    int* new_ids = calloc(ast_id, sizeof(int));
+    CHECK_PTR_MSG(new_ids, "Could not allocate memory");
+    int count = number_live(ast, new_ids, 0);
+    int root = new_ids[ast->id];
+
+    int new_block_count = (count >> AST_BLOCK_SHIFT) + 1; // Ids 0 to count
+    Arena* new_block_arena = new_arena();
+    AST** new_blocks = malloc(new_block_count*sizeof(AST*));
+    CHECK_PTR_MSG(new_blocks, "Could not allocate memory");
+    for(int b=0; b<new_block_count; b++){
+        new_blocks[b] = arena_alloc(new_block_arena, AST_BLOCK_SIZE*sizeof(AST));
+    }
+
+    int new_ids_size = 0;
+    for(int id=1; id<ast_id; id++){
+        AST* node = get_node(id);
+        if(new_ids[id] && node->ranged && node->children[1] > 0) new_ids_size += get_room(node->children[1]);
+    }
+    int* new_list_ids = malloc((new_ids_size ? new_ids_size : 1)*sizeof(int));
+    CHECK_PTR_MSG(new_list_ids, "Could not allocate memory");
+
+    int new_ids_length = 0;
+    for(int id=1; id<ast_id; id++){
+        if(!new_ids[id]) continue;
+        AST* node = get_node(id);
+        int new_id = new_ids[id];
+        AST* copy = &new_blocks[new_id >> AST_BLOCK_SHIFT][new_id & (AST_BLOCK_SIZE-1)];
+        *copy = *node;
+        copy->id = new_id;
+
+        if(!node->ranged){
+            for(int i=0; i<node->length; i++) copy->children[i] = new_ids[node->children[i]];
+        }
+        else if(node->children[1] > 0){
+            int length = node->children[1];
+            for(int i=0; i<length; i++){
+                new_list_ids[new_ids_length+i] = new_ids[ast_list_ids[node->children[0]+i]];
+            }
+            copy->children[0] = new_ids_length;
+            new_ids_length += get_room(length);
+        }
+    }
+
+    free(new_ids);
+    free_arena(block_arena);
+    free(ast_blocks);
+    free(ast_list_ids);
+    block_arena = new_block_arena;
+    ast_blocks = new_blocks;
+    block_count = new_block_count;
+    ast_id = count+1;
+    ast_list_ids = new_list_ids;
+    list_ids_length = new_ids_length;
+    list_ids_size = new_ids_size ? new_ids_size : 1;
+
+    return get_node(root);
+}
+
+void free_shared_ast(){
+    free(shared);
+    shared = NULL;
+    shared_size = 0;
+    shared_count = 0;
+}
+
+void free_all_ast(){
+    free_shared_ast();
+    free_arena(arena);
+    arena = NULL;
+    free_arena(block_arena);
+    block_arena = NULL;
+
+    free(ast_blocks);
+    ast_blocks = NULL;
+    block_count = 0;
+    ast_id = 1;
+
+    free(ast_list_ids);
+    ast_list_ids = NULL;
+    list_ids_length = list_ids_size = 0;
+
+    free(names);
+    free(name_table);
+    names = NULL;
+    name_table = NULL;
+    name_count = names_size = name_table_size = 0;
+}
+
 
 // Modify
 AST* set_ast_data(AST* ast, double data){
     CHECK_PTR(ast);
-    ast->data = data;
+    if(ast->kind == REAL_VAL_NODE) ast->data.as_float = data;
+    else                           ast->data.as_int = (long long) data;
     return ast;
 }
 
@@ -65,22 +406,23 @@ AST* add_ast_child(AST* parent, AST* child){
     CHECK_PTR(parent);
     CHECK_PTR(child);
 
-    // Aloca mais espaço quando necessário
-    if (parent->children_length%AST_CHILDREN_BLOCK_SIZE == 0) {
-        int new_size = AST_CHILDREN_BLOCK_SIZE + parent->children_length;
-        parent->children = realloc(parent->children, new_size*sizeof(AST*));
-        CHECK_PTR_MSG(parent->children, "Could not reallocate memory");
+    if (!parent->ranged && parent->length < AST_INLINE_CHILDREN) {
+        parent->children[parent->length++] = child->id;
+        return parent;
     }
 
-    parent->children[parent->children_length++] = child;
+    // Aloca mais espaço quando necessário, dobrando o tamanho
+    if (!parent->ranged) make_ranged(parent);
+    grow_range(parent);
+
+    ast_list_ids[parent->children[0] + parent->children[1]++] = child->id;
     return parent;
 }
 
 AST* set_ast_name(AST* ast, char* name){
     CHECK_PTR(ast);
     if(name && !ast->name){
-        ast->name = malloc(sizeof(char)*strlen(name));
-        strcpy(ast->name, name);
+        ast->name = intern_name(name);
     }
     return ast;
 }
@@ -88,9 +430,9 @@ AST* set_ast_name(AST* ast, char* name){
 AST* set_ast_child(AST* ast, int i, AST* child){
     CHECK_PTR(ast);
     CHECK_PTR(child);
-    CHECK_BOUNDS(i, ast->children_length);
+    CHECK_BOUNDS(i, get_ast_length(ast));
 
-    ast->children[i] = child;
+    get_children(ast)[i] = child->id;
     return ast;
 }
 
@@ -133,19 +475,35 @@ void print_ast(AST* ast){
 }
 
 
-void gen_ast_dot(AST* ast){
-    CHECK_PTR(ast);
-    FILE* ast_file = fopen("ast.dot", "w");
-    fprintf(ast_file, "digraph {\ngraph [ordering=\"out\"];\n");
-    gen_ast_node_dot(ast, ast_file);
-    fprintf(ast_file, "}\n");
-    fclose(ast_file);
+// Dot output -----------------------------------------------------------------
+// The tree is walked with an explicit stack, deep nesting can't overflow the
+// C stack. Shared nodes are written once, with an edge from each of their
+// parents. Below max_depth (0 for none) a node's children not written yet
+// collapse into a single dashed node holding their count. A DotStyle, when
+// given, adds to the labels and attributes (see profile.c).
+
+typedef struct {
+    AST* node;
+    int depth;
+    int next; // Next child to write
+} DotFrame;
+
+typedef struct {
+    DotFrame* frames;
+    int length;
+    int size;
+} DotStack;
+
+static void push_dot(DotStack* stack, AST* node, int depth){
+    if(stack->length == stack->size){
+        stack->size += AST_DOT_STACK_SIZE;
+        stack->frames = realloc(stack->frames, stack->size*sizeof(DotFrame));
+        CHECK_PTR_MSG(stack->frames, "Could not reallocate memory");
+    }
+    stack->frames[stack->length++] = (DotFrame){node, depth, 0};
 }
 
-void gen_ast_node_dot(AST* node, FILE* ast_file){
-    
-    CHECK_PTR(node);
-
+static void write_dot_label(AST* node, FILE* ast_file, DotStyle* style){
     fprintf(ast_file, "node%d[label=\"", node->id);
     switch (node->kind){
         case VAR_DECL_NODE: fprintf(ast_file, "%s %s", get_type_str(get_ast_type(node)), get_ast_name(node));
@@ -154,34 +512,134 @@ void gen_ast_node_dot(AST* node, FILE* ast_file){
         case VAR_USE_NODE: fprintf(ast_file, "%s (%s)", get_ast_name(node), get_type_str(get_ast_type(node)));
         break;
 
-        case BOOL_VAL_NODE: fprintf(ast_file, "%s (bool)", node->data?"true":"false");
+        case BOOL_VAL_NODE: fprintf(ast_file, "%s (bool)", get_ast_data(node)?"true":"false");
         break;
 
-        case INT_VAL_NODE: fprintf(ast_file, "%d (int)", (int) node->data);
+        case INT_VAL_NODE: fprintf(ast_file, "%d (int)", (int) get_ast_data(node));
         break;
 
-        case REAL_VAL_NODE: fprintf(ast_file, "%0.2f (real)", node->data);
+        case REAL_VAL_NODE: fprintf(ast_file, "%0.2f (real)", get_ast_data(node));
         break;
 
-        case STR_VAL_NODE: fprintf(ast_file, "@%d (string)", (int) node->data);
+        case STR_VAL_NODE: fprintf(ast_file, "@%d (string)", (int) get_ast_data(node));
         break;
 
         default: fprintf(ast_file, "%s", get_kind_str(node->kind));
         break;
     }
-    fprintf(ast_file, "\"];\n");
-    
-    for (int i=0; i<node->children_length; i++) {
-        AST* child = node->children[i];
-        if(child){
-            gen_ast_node_dot(child, ast_file);
-            fprintf(ast_file, "node%d -> node%d;\n", node->id, child->id);
+    if(style && style->label) style->label(node, ast_file);
+    fprintf(ast_file, "\"");
+    if(style && style->node) style->node(node, ast_file);
+    fprintf(ast_file, "];\n");
+}
+
+static void write_dot_edge(AST* node, int i, AST* child, FILE* ast_file, DotStyle* style){
+    fprintf(ast_file, "node%d -> node%d", node->id, child->id);
+    if(style && style->edge) style->edge(node, i, ast_file);
+    fprintf(ast_file, ";\n");
+}
+
+// visited: 1 written, 2 counted in a collapsed node. Counts node and what is
+// under it neither written nor counted yet, walking above the frames in use.
+static int count_hidden(AST* node, char* visited, DotStack* stack){
+    int base = stack->length;
+    int count = 1;
+    visited[node->id] = 2;
+    push_dot(stack, node, 0);
+
+    while(stack->length > base){
+        AST* top = stack->frames[--stack->length].node;
+        for(int i=0; i<get_ast_length(top); i++){
+            AST* child = get_ast_child(top, i);
+            if(!child || visited[child->id]) continue;
+            visited[child->id] = 2;
+            count++;
+            push_dot(stack, child, 0);
+        }
+    }
+    return count;
+}
+
+static void write_dot_node(AST* node, int depth, int max_depth, FILE* ast_file, char* visited, DotStack* stack, DotStyle* style){
+    visited[node->id] = 1;
+    write_dot_label(node, ast_file, style);
+    if(max_depth <= 0 || depth < max_depth){
+        push_dot(stack, node, depth);
+        return;
+    }
+
+    int hidden = 0;
+    for(int i=0; i<get_ast_length(node); i++){
+        AST* child = get_ast_child(node, i);
+        if(!child) continue;
+        if(visited[child->id] == 1) write_dot_edge(node, i, child, ast_file, style);
+        else if(!visited[child->id]) hidden += count_hidden(child, visited, stack);
+    }
+    if(hidden){
+        fprintf(ast_file, "more%d[label=\"%d more\", shape=box, style=dashed];\n", node->id, hidden);
+        fprintf(ast_file, "node%d -> more%d[style=dashed];\n", node->id, node->id);
+    }
+}
+
+static void write_dot(AST* ast, FILE* ast_file, int max_depth, DotStyle* style){
+    char* visited = calloc(ast_id, sizeof(char));
+    CHECK_PTR_MSG(visited, "Could not allocate memory");
+    DotStack stack = {NULL, 0, 0};
+
+    write_dot_node(ast, 0, max_depth, ast_file, visited, &stack, style);
+    while(stack.length > 0){
+        DotFrame* frame = &stack.frames[stack.length-1];
+        if(frame->next == get_ast_length(frame->node)){
+            stack.length--;
+            continue;
         }
+
+        AST* node = frame->node;
+        int depth = frame->depth;
+        int i = frame->next++;
+        AST* child = get_ast_child(node, i);
+        if(!child) continue;
+        if(visited[child->id] != 1) write_dot_node(child, depth+1, max_depth, ast_file, visited, &stack, style);
+        write_dot_edge(node, i, child, ast_file, style);
     }
+
+    free(stack.frames);
+    free(visited);
+}
+
+void gen_ast_dot(AST* ast, char* path, int max_depth){
+    gen_ast_styled_dot(ast, path, max_depth, NULL);
+}
+
+void gen_ast_styled_dot(AST* ast, char* path, int max_depth, DotStyle* style){
+    CHECK_PTR(ast);
+    FILE* ast_file = fopen(path, "w");
+    CHECK_PTR_MSG(ast_file, "Could not open the dot file");
+    setvbuf(ast_file, NULL, _IOFBF, AST_DOT_BUF_SIZE);
+
+    fprintf(ast_file, "digraph {\ngraph [ordering=\"out\"];\n");
+    write_dot(ast, ast_file, max_depth, style);
+    fprintf(ast_file, "}\n");
+    fclose(ast_file);
+}
+
+void gen_ast_node_dot(AST* node, FILE* ast_file){
+    CHECK_PTR(node);
+    write_dot(node, ast_file, 0, NULL);
 }
 
 
 // Get
+int get_last_ast_id(){
+    return ast_id-1;
+}
+
+char* get_ast_name(AST* ast){
+    CHECK_PTR(ast);
+    return names ? names[ast->name] : NULL;
+}
+
+#ifndef NDEBUG // Inlined in ast.h otherwise
 int get_ast_id(AST* ast){
     CHECK_PTR(ast);
     return ast->id;
@@ -192,11 +650,6 @@ int get_ast_line(AST* ast){
     return ast->line;
 }
 
-char* get_ast_name(AST* ast){
-    CHECK_PTR(ast);
-    return ast->name;
-}
-
 Type get_ast_type(AST* ast){
     CHECK_PTR(ast);
     return ast->type;
@@ -209,19 +662,30 @@ NodeKind get_ast_kind(AST* ast){
 
 double get_ast_data(AST* ast){
     CHECK_PTR(ast);
-    return ast->data;
+    if(ast->kind == REAL_VAL_NODE) return ast->data.as_float;
+    return ast->data.as_int;
 }
 
 int get_ast_length(AST* ast){
     CHECK_PTR(ast);
-    return ast->children_length;
+    return ast->ranged ? ast->children[1] : ast->length;
 }
 
+// Called for every node the interpreter runs, so written out in full.
 AST* get_ast_child(AST* ast, int i){
     CHECK_PTR(ast);
-    if(i>=ast->children_length) return NULL;
-    return ast->children[i];
+    int id;
+    if(ast->ranged){
+        if(i>=ast->children[1]) return NULL;
+        id = ast_list_ids[ast->children[0] + i];
+    }
+    else{
+        if(i>=ast->length) return NULL;
+        id = ast->children[i];
+    }
+    return &ast_blocks[id >> AST_BLOCK_SHIFT][id & (AST_BLOCK_SIZE-1)];
 }
+#endif
 
 char* get_op_str(Op op){
     switch (op){
@@ -255,6 +719,11 @@ char* get_kind_str(NodeKind kind) {
         case MINUS_NODE:         return "-";
         case TIMES_NODE:         return "*";
         case OVER_NODE:          return "/";
+        case SHL_NODE:           return "<<";
+        case DIV_CONST_NODE:     return "/ (magic)";
+        case TRIP_COUNT_NODE:    return "trip count";
+        case CHOOSE_NODE:        return "choose";
+        case SAFE_OVER_NODE:     return "/ (safe)";
         
         case VAR_USE_NODE:       return "var_use";
         case BOOL_VAL_NODE:      return "bool_val";
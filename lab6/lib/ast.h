@@ -1,10 +1,18 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stdio.h>
 #include "debug.h"
 #include "type.h"
 
-#define AST_CHILDREN_BLOCK_SIZE 10
+#define AST_INLINE_CHILDREN 2    // Children kept in the node, more go aside
+#define AST_LIST_MIN_SIZE 4      // List ranges double from there
+#define AST_BLOCK_SHIFT 12
+#define AST_BLOCK_SIZE (1 << AST_BLOCK_SHIFT) // Nodes per pool block
+#define AST_NAMES_INITIAL_SIZE 64 // Power of two
+#define AST_SHARED_INITIAL_SIZE 1024 // Power of two
+#define AST_DOT_BUF_SIZE (1 << 20)
+#define AST_DOT_STACK_SIZE 64    // Dot traversal stack grows by this
 
 typedef enum {
 
@@ -23,6 +31,11 @@ typedef enum {
     MINUS_NODE,  // -
     TIMES_NODE,  // *
     OVER_NODE,   // /
+    SHL_NODE,       // << (int * power of two, see strength.c)
+    DIV_CONST_NODE, // int / constant, by multiplication (see strength.c)
+    TRIP_COUNT_NODE, // Iterations of a counting loop (see scev.c)
+    CHOOSE_NODE,     // Binomial coefficient (see scev.c)
+    SAFE_OVER_NODE,  // int / divisor never 0 (see range.c)
     VAR_USE_NODE,
     BOOL_VAL_NODE,
     INT_VAL_NODE,
@@ -55,9 +68,48 @@ typedef struct {
 
 typedef struct ast AST;
 
+// Additions to the dot output, each may be NULL
+typedef struct {
+    void (*label)(AST* node, FILE* file); // Text after the node's label
+    void (*node)(AST* node, FILE* file);  // Attributes, each as ", name=value"
+    void (*edge)(AST* parent, int i, FILE* file); // Edge to child i, "[...]" or nothing
+} DotStyle;
+
+// Nodes live in a pool of AST_BLOCK_SIZE node blocks and refer to each other
+// by id, their index in the pool. Up to AST_INLINE_CHILDREN children are
+// kept in the node itself. Statement and declaration lists, and nodes given
+// more children (if with else, ...), keep theirs as a range of ast_list_ids: its
+// room is the power of two from AST_LIST_MIN_SIZE holding them, and a full
+// range moves to the end of ast_list_ids with twice the room. Names are
+// interned, a node holds the index of its own.
+struct ast {
+    int id;
+    unsigned char kind;   // NodeKind
+    unsigned char type;   // Type
+    unsigned char length; // Children kept in the node
+    unsigned char ranged; // Children in ast_list_ids, from children[0], children[1] of them
+    int line;
+    int name;             // Index in names, 0 for none
+    union {
+        int as_int;       // Values, string and variable indexes
+        float as_float;   // REAL_VAL_NODE, reals are floats at runtime
+    } data;
+    int children[AST_INLINE_CHILDREN]; // Ids, or start and length in ast_list_ids
+};
+
+extern AST** ast_blocks;  // The pool, a node is ast_blocks[id >> AST_BLOCK_SHIFT][id & (AST_BLOCK_SIZE-1)]
+extern int* ast_list_ids; // Children of ranged nodes
+
 // Create
 AST* new_ast(NodeKind kind, char* name, int line, Type type, double data);
 AST* new_ast_subtree(NodeKind kind, char* name, int line, Type type, int child_count, ...);
+AST* copy_ast(AST* ast);
+void free_all_ast(); // Every node, child array and name, in one go
+
+// Hash-consing: identical expressions are the same node, never to be modified
+AST* share_ast(AST* ast); // Shares the expressions of a tree and compacts, returns its root
+void free_shared_ast();
+AST* compact_ast(AST* ast); // Keeps only the nodes under ast, renumbered; returns it
 
 // Modify
 AST* set_ast_data(AST* ast, double data);
@@ -69,19 +121,64 @@ AST* set_ast_child(AST* ast, int i, AST* child);
 
 // Output
 void print_ast(AST* ast);
-void gen_ast_dot(AST* ast);
+void gen_ast_dot(AST* ast, char* path, int max_depth); // 0: no depth limit
+void gen_ast_styled_dot(AST* ast, char* path, int max_depth, DotStyle* style);
 void gen_ast_node_dot(AST* node, FILE* ast_file);
 
 // Get
+int get_last_ast_id();
+char* get_ast_name(AST* ast);
+char* get_op_str(Op op);
+char* get_kind_str(NodeKind kind);
+
+#ifndef NDEBUG
 int get_ast_id(AST* ast);
 int get_ast_line(AST* ast);
-char* get_ast_name(AST* ast);
 Type get_ast_type(AST* ast);
 NodeKind get_ast_kind(AST* ast);
 double get_ast_data(AST* ast);
 int get_ast_length(AST* ast);
 AST* get_ast_child(AST* ast, int i);
-char* get_op_str(Op op);
-char* get_kind_str(NodeKind kind);
+#else
+// Release build (make release): the accessors the interpreter calls for
+// every node it runs are inlined, unchecked.
+static inline int get_ast_id(AST* ast){
+    return ast->id;
+}
+
+static inline int get_ast_line(AST* ast){
+    return ast->line;
+}
+
+static inline Type get_ast_type(AST* ast){
+    return ast->type;
+}
+
+static inline NodeKind get_ast_kind(AST* ast){
+    return ast->kind;
+}
+
+static inline double get_ast_data(AST* ast){
+    if(ast->kind == REAL_VAL_NODE) return ast->data.as_float;
+    return ast->data.as_int;
+}
+
+static inline int get_ast_length(AST* ast){
+    return ast->ranged ? ast->children[1] : ast->length;
+}
+
+static inline AST* get_ast_child(AST* ast, int i){
+    int id;
+    if(ast->ranged){
+        if(i>=ast->children[1]) return NULL;
+        id = ast_list_ids[ast->children[0] + i];
+    }
+    else{
+        if(i>=ast->length) return NULL;
+        id = ast->children[i];
+    }
+    return &ast_blocks[id >> AST_BLOCK_SHIFT][id & (AST_BLOCK_SIZE-1)];
+}
+#endif
 
 #endif
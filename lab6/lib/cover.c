@@ -0,0 +1,81 @@
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "cover.h"
+
+static unsigned char spare_hit; // Where every node hits when coverage is off
+
+unsigned char* cover_hits = &spare_hit;
+int cover_mask = 0;
+
+static char* info_file_path = NULL;
+static char source_file_path[PATH_MAX];
+
+void init_cover(char* info_path, char* source_path){
+    cover_hits = calloc(get_last_ast_id() + 1, sizeof(unsigned char));
+    CHECK_PTR_MSG(cover_hits, "Could not allocate memory");
+    cover_mask = -1;
+    info_file_path = info_path;
+
+    // genhtml looks the source up by this name, wherever it runs from
+    if(!realpath(source_path, source_file_path)){
+        snprintf(source_file_path, PATH_MAX, "%s", source_path);
+    }
+}
+
+// lines[l]: -1 no node on line l, else whether one of them ran
+typedef struct {
+    signed char* lines;
+    int size;
+} LineHits;
+
+// Declarations are not run, they are left out like comments.
+static void add_line_hits(AST* ast, LineHits* table, char* visited){
+    int id = get_ast_id(ast);
+    if(visited[id] || get_ast_kind(ast) == VAR_DECL_LIST_NODE) return;
+    visited[id] = 1;
+
+    int line = get_ast_line(ast);
+    if(line >= table->size){
+        int size = table->size;
+        while(line >= table->size) table->size += COVER_LINES_SIZE;
+        table->lines = realloc(table->lines, table->size*sizeof(signed char));
+        CHECK_PTR_MSG(table->lines, "Could not reallocate memory");
+        for(int l=size; l<table->size; l++) table->lines[l] = -1;
+    }
+    if(line && table->lines[line] < 1) table->lines[line] = cover_hits[id]; // 0: none
+
+    for(int i=0; i<get_ast_length(ast); i++){
+        AST* child = get_ast_child(ast, i);
+        if(child) add_line_hits(child, table, visited);
+    }
+}
+
+void report_cover(AST* ast){
+    if(!cover_mask || !ast) return;
+
+    char* visited = calloc(get_last_ast_id() + 1, sizeof(char));
+    CHECK_PTR_MSG(visited, "Could not allocate memory");
+    LineHits table = {NULL, 0};
+    add_line_hits(ast, &table, visited);
+
+    FILE* file = fopen(info_file_path, "w");
+    CHECK_PTR_MSG(file, "Could not open the coverage file");
+    int found = 0, hit = 0;
+    fprintf(file, "TN:\nSF:%s\n", source_file_path);
+    for(int l=1; l<table.size; l++){
+        if(table.lines[l] < 0) continue;
+        fprintf(file, "DA:%d,%d\n", l, table.lines[l]);
+        found++;
+        hit += table.lines[l];
+    }
+    fprintf(file, "LF:%d\nLH:%d\nend_of_record\n", found, hit);
+    fclose(file);
+
+    free(table.lines);
+    free(visited);
+    free(cover_hits);
+    cover_hits = &spare_hit;
+    cover_mask = 0; // Once, a runtime error may come after the run
+}
@@ -0,0 +1,31 @@
+#ifndef COVER_H
+#define COVER_H
+
+#include "debug.h"
+#include "ast.h"
+
+// Line coverage -------------------------------------
+// rec_run_ast stores a 1 at cover_hits[id & cover_mask] for every node it
+// runs, without a test: when coverage is off the mask is 0 and every node
+// hits the same spare byte. At the end a line counts as run when any node
+// on it ran, and the lines go to an lcov tracefile for genhtml. The counts
+// there are 0 or 1, the hits are bits and not counters. Lines the optimizer
+// removed have no node left, lcov sees them as not code.
+#define COVER_LINES_SIZE 64 // Line table grows by this
+
+extern unsigned char* cover_hits;
+extern int cover_mask; // 0 or -1
+
+// Create
+void init_cover(char* info_path, char* source_path); // Once the tree is final
+
+// Modify
+static inline void cover_node(AST* ast){
+    cover_hits[get_ast_id(ast) & cover_mask] = 1;
+}
+
+// Output
+void report_cover(AST* ast); // Writes the tracefile and frees, once
+//----------------------------------------------------
+
+#endif // COVER_H
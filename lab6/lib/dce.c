@@ -0,0 +1,150 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimizer.h"
+
+// Dead code elimination
+// ----------------------------------------------------------------------------
+// Runs after folding, when a constant condition is a BOOL_VAL_NODE:
+//   - if true/false ... keeps only the branch that is taken;
+//   - repeat ... until true runs its body exactly once, so it becomes the body;
+//   - an if whose branches are (or became) empty goes away;
+//   - x := x, and assignments to variables whose value is never read, go away.
+// Both of the last two keep an expression that may trap: a division by zero
+// stops the program, however unused its result. Reads are kept even into
+// unused variables since they consume input.
+
+extern VarTable *vt;
+
+static AST* dce_stmt_list(AST* list, char* observed, int* changed);
+
+// Marks every variable whose value is read somewhere in ast.
+static void mark_observed(AST* ast, char* observed){
+    if(!ast) return;
+
+    switch(get_ast_kind(ast)){
+        case VAR_USE_NODE:
+            observed[(int) get_ast_data(ast)] = 1;
+            return;
+
+        case ASSIGN_NODE: // The target is written, not read
+            mark_observed(get_ast_child(ast, 1), observed);
+            return;
+
+        case READ_NODE:
+            return;
+
+        default:
+            for(int i=0; i<get_ast_length(ast); i++){
+                mark_observed(get_ast_child(ast, i), observed);
+            }
+    }
+}
+
+static int is_true(AST* cond){
+    return get_ast_data(cond) != 0; // Same test as run_if
+}
+
+static int is_empty(AST* list){
+    return !list || get_ast_length(list) == 0;
+}
+
+// Returns NULL to delete stmt, a STMT_LIST_NODE to splice in its place, or
+// the statement to keep.
+static AST* dce_stmt(AST* stmt, char* observed, int* changed){
+
+    switch(get_ast_kind(stmt)){
+
+        case IF_NODE: {
+            AST* cond = get_ast_child(stmt, 0);
+            AST* then_list = dce_stmt_list(get_ast_child(stmt, 1), observed, changed);
+            AST* else_list = dce_stmt_list(get_ast_child(stmt, 2), observed, changed);
+
+            if(get_ast_kind(cond) == BOOL_VAL_NODE){
+                *changed = 1;
+                return is_true(cond) ? then_list : else_list;
+            }
+            if(is_empty(then_list) && is_empty(else_list) && !may_trap(cond)){
+                *changed = 1;
+                return NULL;
+            }
+
+            set_ast_child(stmt, 1, then_list);
+            if(else_list) set_ast_child(stmt, 2, else_list);
+            return stmt;
+        }
+
+        case REPEAT_NODE: {
+            AST* cond = get_ast_child(stmt, 0);
+            AST* body = dce_stmt_list(get_ast_child(stmt, 1), observed, changed);
+
+            if(get_ast_kind(cond) == BOOL_VAL_NODE && is_true(cond)){
+                *changed = 1;
+                return body;
+            }
+
+            set_ast_child(stmt, 1, body);
+            return stmt;
+        }
+
+        case ASSIGN_NODE: {
+            AST* var_use = get_ast_child(stmt, 0);
+            AST* expr = get_ast_child(stmt, 1);
+            int var = get_ast_data(var_use);
+
+            int self = get_ast_kind(expr) == VAR_USE_NODE && (int) get_ast_data(expr) == var;
+            if(self || (!observed[var] && !may_trap(expr))){
+                *changed = 1;
+                return NULL;
+            }
+            return stmt;
+        }
+
+        default:
+            return stmt;
+    }
+}
+
+static AST* dce_stmt_list(AST* list, char* observed, int* changed){
+    if(!list) return NULL;
+
+    AST* new_list = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(list), NO_TYPE, 0);
+
+    for(int i=0; i<get_ast_length(list); i++){
+        AST* stmt = dce_stmt(get_ast_child(list, i), observed, changed);
+        if(!stmt) continue;
+
+        if(get_ast_kind(stmt) == STMT_LIST_NODE){
+            for(int j=0; j<get_ast_length(stmt); j++){
+                add_ast_child(new_list, get_ast_child(stmt, j));
+            }
+        }
+        else{
+            add_ast_child(new_list, stmt);
+        }
+    }
+
+    return new_list;
+}
+
+AST* elim_dead_code(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    int var_count = get_var_table_length(vt);
+    char* observed = malloc(var_count + 1);
+    CHECK_PTR_MSG(observed, "Could not allocate memory");
+
+    // Removing an assignment can leave the variables it read unobserved.
+    int changed;
+    do{
+        changed = 0;
+        memset(observed, 0, var_count + 1);
+        mark_observed(get_ast_child(ast, 1), observed);
+        set_ast_child(ast, 1, dce_stmt_list(get_ast_child(ast, 1), observed, &changed));
+    } while(changed);
+
+    free(observed);
+    return ast;
+}
@@ -8,11 +8,19 @@
 
 #define SWITCH_ERROR(expr) GENERIC_ERROR("'%s' does not match any switch case", #expr);
 
-#define CHECK_PTR(ptr); if(!ptr){GENERIC_ERROR("'%s' can't be a null pointer", #ptr);}
-
 #define CHECK_PTR_MSG(ptr, msg); if(!ptr){GENERIC_ERROR("%s ('%s' can't be a null pointer)", msg, #ptr);}
 
+// Release build (-D NDEBUG): the checks on arguments compile away, failed
+// allocations are still reported
+#ifndef NDEBUG
+#define CHECK_PTR(ptr); if(!ptr){GENERIC_ERROR("'%s' can't be a null pointer", #ptr);}
+
 #define CHECK_BOUNDS(idx, length); if(idx<0 || idx>=length){GENERIC_ERROR("Index out of bounds: [0 <= %s < %s]", #idx, #length);}
+#else
+#define CHECK_PTR(ptr);
+
+#define CHECK_BOUNDS(idx, length);
+#endif
 
 
 // DEBUG_H
@@ -0,0 +1,170 @@
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimizer.h"
+#include "output.h"
+
+// Constant folding
+// ----------------------------------------------------------------------------
+// Evaluates every operation and conversion whose operands are all constants,
+// with the exact semantics of interpreter.c: reals are floats, ints wrap,
+// strings are concatenated as stored in the table (quotes included) and
+// numbers are turned into text by the same fmt_int/fmt_real. Divisions that
+// would trap at runtime are left alone.
+
+extern StrTable *st;
+
+static AST* new_bool(AST* old, int x){
+    return new_ast(BOOL_VAL_NODE, NULL, get_ast_line(old), BOOL_TYPE, x);
+}
+
+static AST* new_int(AST* old, int x){
+    return new_ast(INT_VAL_NODE, NULL, get_ast_line(old), INT_TYPE, x);
+}
+
+static AST* new_real(AST* old, float x){
+    return new_ast(REAL_VAL_NODE, NULL, get_ast_line(old), REAL_TYPE, x);
+}
+
+static AST* new_str(AST* old, char* s){
+    return new_ast(STR_VAL_NODE, NULL, get_ast_line(old), STR_TYPE, add_table_str(st, s));
+}
+
+static int int_of(AST* ast){
+    return (int) get_ast_data(ast);
+}
+
+static float real_of(AST* ast){
+    return (float) get_ast_data(ast);
+}
+
+static char* str_of(AST* ast){
+    return get_table_str(st, (int) get_ast_data(ast));
+}
+
+static AST* fold_conversion(AST* ast){
+    AST* child = get_ast_child(ast, 0);
+    char buf[FMT_NUM_MAX_SIZE];
+
+    switch(get_ast_kind(ast)){
+        case B2I_NODE: return new_int(ast, int_of(child));
+        case B2R_NODE: return new_real(ast, int_of(child));
+        case B2S_NODE: return new_str(ast, int_of(child) == 0 ? "false" : "true");
+        case I2R_NODE: return new_real(ast, int_of(child));
+        case I2S_NODE: fmt_int(buf, int_of(child));   return new_str(ast, buf);
+        case R2S_NODE: fmt_real(buf, real_of(child)); return new_str(ast, buf);
+        default:       return ast;
+    }
+}
+
+static AST* fold_str_operation(AST* ast, AST* l, AST* r){
+    char* l_str = str_of(l);
+    char* r_str = str_of(r);
+
+    switch(get_ast_kind(ast)){
+        case LT_NODE: return new_bool(ast, strcmp(l_str, r_str) < 0);
+        case EQ_NODE: return new_bool(ast, strcmp(l_str, r_str) == 0);
+        case PLUS_NODE: {
+            int l_length = strlen(l_str);
+            char* s = malloc(l_length + strlen(r_str) + 1);
+            CHECK_PTR_MSG(s, "Could not allocate memory");
+            strcpy(s, l_str);
+            strcpy(s+l_length, r_str);
+            AST* folded = new_str(ast, s);
+            free(s);
+            return folded;
+        }
+        default: return ast;
+    }
+}
+
+static AST* fold_real_operation(AST* ast, AST* l, AST* r){
+    float x = real_of(l);
+    float y = real_of(r);
+
+    switch(get_ast_kind(ast)){
+        case LT_NODE:    return new_bool(ast, x < y);
+        case EQ_NODE:    return new_bool(ast, x == y);
+        case PLUS_NODE:  return new_real(ast, x + y);
+        case MINUS_NODE: return new_real(ast, x - y);
+        case TIMES_NODE: return new_real(ast, x * y);
+        case OVER_NODE:  return new_real(ast, x / y);
+        default:         return ast;
+    }
+}
+
+// Ints and bools (bool + bool is an int addition at runtime too).
+static AST* fold_int_operation(AST* ast, AST* l, AST* r){
+    int x = int_of(l);
+    int y = int_of(r);
+    unsigned int ux = x, uy = y; // Wrap around like the hardware does
+
+    AST* (*make)(AST*, int) = get_ast_type(ast) == BOOL_TYPE ? new_bool : new_int;
+
+    switch(get_ast_kind(ast)){
+        case LT_NODE:    return new_bool(ast, x < y);
+        case EQ_NODE:    return new_bool(ast, x == y);
+        case PLUS_NODE:  return make(ast, (int) (ux + uy));
+        case MINUS_NODE: return make(ast, (int) (ux - uy));
+        case TIMES_NODE: return make(ast, (int) (ux * uy));
+        case OVER_NODE:
+            if(y == 0) return ast; // Runtime error
+            if(y == -1) return make(ast, (int) (0u - ux)); // INT_MIN / -1 wraps
+            return make(ast, x / y);
+        default: return ast;
+    }
+}
+
+static AST* fold_operation(AST* ast){
+    AST* l = get_ast_child(ast, 0);
+    AST* r = get_ast_child(ast, 1);
+
+    // Conversions were inserted by eval_operation, so both sides agree.
+    switch(get_ast_type(l)){
+        case STR_TYPE:  return fold_str_operation(ast, l, r);
+        case REAL_TYPE: return fold_real_operation(ast, l, r);
+        case INT_TYPE:
+        case BOOL_TYPE: return fold_int_operation(ast, l, r);
+        default:        return ast;
+    }
+}
+
+// Folds ast if all its operands are constants, returns ast itself otherwise.
+AST* fold_node(AST* ast){
+    switch(get_ast_kind(ast)){
+        case B2I_NODE:
+        case B2R_NODE:
+        case B2S_NODE:
+        case I2R_NODE:
+        case I2S_NODE:
+        case R2S_NODE:
+            if(!is_const_ast(get_ast_child(ast, 0))) return ast;
+            return fold_conversion(ast);
+
+        case LT_NODE:
+        case EQ_NODE:
+        case PLUS_NODE:
+        case MINUS_NODE:
+        case TIMES_NODE:
+        case OVER_NODE:
+            if(!is_const_ast(get_ast_child(ast, 0)) || !is_const_ast(get_ast_child(ast, 1))) return ast;
+            return fold_operation(ast);
+
+        default:
+            return ast;
+    }
+}
+
+AST* fold_constants(AST* ast){
+    if(!ast) return ast;
+
+    for(int i=0; i<get_ast_length(ast); i++){
+        AST* child = get_ast_child(ast, i);
+        AST* folded = fold_constants(child);
+        if(folded != child) set_ast_child(ast, i, folded);
+    }
+
+    return fold_node(ast);
+}
@@ -0,0 +1,347 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "optimizer.h"
+
+// Value numbering and common subexpression elimination
+// ----------------------------------------------------------------------------
+// Every expression gets a value number built from its kind, type and the
+// numbers of its operands; a variable use is numbered by the variable and
+// its current version, which := and read bump. Two computations in the same
+// statement list with the same number are therefore equal, and the pass
+// computes the value once into a temporary declared right before the first
+// statement that needs it. Conversion nodes added by eval_operation are
+// numbered like any other operation, so repeated I2R/I2S/... go too.
+//
+// if/repeat statements are opaque to the list holding them: an if condition
+// is an ordinary use, then everything assigned inside bumps its version.
+// Their own lists are handled on their own.
+
+#define VN_TABLE_INIT_SIZE 1024
+#define OCC_BLOCK_SIZE 256
+
+typedef struct {
+    NodeKind kind;
+    Type type;
+    double data;  // Constant value or variable address
+    int version;  // Version of the variable (VAR_USE_NODE only)
+    int l_vn;     // Value numbers of the operands, -1 if absent
+    int r_vn;
+} VNKey;
+
+typedef struct {
+    AST* node;
+    AST* parent;  // node is parent's child number 'child'
+    int child;
+    int stmt;     // Index in the statement list
+    int order;    // Position in evaluation order (children first)
+    int vn;
+} Occ;
+
+static VNKey* vn_keys = NULL; // Indexed by value number
+static int vn_count = 0;
+static int vn_cap = 0;
+static int* vn_slots = NULL;  // Open addressing, value number + 1 or 0
+static int slot_cap = 0;
+
+static int version[MEM_SIZE];
+static int next_version = 0;
+
+static Occ* occs = NULL;
+static int occ_count = 0;
+static int occ_cap = 0;
+static int occ_order = 0;
+
+static char* touched = NULL;  // Indexed by node id
+static int touched_size = 0;
+
+
+// Value table ----------------------------------------------------------------
+
+static unsigned int hash_key(VNKey* k){
+    unsigned long long bits;
+    memcpy(&bits, &k->data, sizeof(bits));
+    unsigned long long h = k->kind;
+    h = h*31 + k->type;
+    h = h*31 + bits;
+    h = h*31 + k->version;
+    h = h*31 + (unsigned int) k->l_vn;
+    h = h*31 + (unsigned int) k->r_vn;
+    return (unsigned int) (h ^ (h >> 29));
+}
+
+static int same_key(VNKey* a, VNKey* b){
+    return a->kind == b->kind && a->type == b->type && a->data == b->data &&
+           a->version == b->version && a->l_vn == b->l_vn && a->r_vn == b->r_vn;
+}
+
+static void grow_slots(){
+    free(vn_slots);
+    slot_cap = slot_cap ? slot_cap*2 : VN_TABLE_INIT_SIZE;
+    vn_slots = calloc(slot_cap, sizeof(int));
+    CHECK_PTR_MSG(vn_slots, "Could not allocate memory");
+
+    for(int vn=0; vn<vn_count; vn++){
+        unsigned int i = hash_key(&vn_keys[vn]) & (slot_cap-1);
+        while(vn_slots[i]) i = (i+1) & (slot_cap-1);
+        vn_slots[i] = vn+1;
+    }
+}
+
+static int lookup_vn(VNKey* k){
+    if(2*(vn_count+1) > slot_cap) grow_slots();
+
+    unsigned int i = hash_key(k) & (slot_cap-1);
+    while(vn_slots[i]){
+        if(same_key(&vn_keys[vn_slots[i]-1], k)) return vn_slots[i]-1;
+        i = (i+1) & (slot_cap-1);
+    }
+
+    if(vn_count == vn_cap){
+        vn_cap = vn_cap ? vn_cap*2 : VN_TABLE_INIT_SIZE;
+        vn_keys = realloc(vn_keys, vn_cap*sizeof(VNKey));
+        CHECK_PTR_MSG(vn_keys, "Could not reallocate memory");
+    }
+    vn_keys[vn_count] = *k;
+    vn_slots[i] = vn_count+1;
+    return vn_count++;
+}
+
+static void kill_var(int var){
+    version[var] = ++next_version;
+}
+
+static void kill_assigned(AST* stmt){
+    char assigned[MEM_SIZE] = {0};
+    mark_assigned(stmt, assigned);
+    for(int var=0; var<MEM_SIZE; var++){
+        if(assigned[var]) kill_var(var);
+    }
+}
+
+
+// Occurrences ----------------------------------------------------------------
+
+static void add_occ(AST* node, AST* parent, int child, int stmt, int vn){
+    if(occ_count == occ_cap){
+        occ_cap += OCC_BLOCK_SIZE;
+        occs = realloc(occs, occ_cap*sizeof(Occ));
+        CHECK_PTR_MSG(occs, "Could not reallocate memory");
+    }
+    Occ occ = {node, parent, child, stmt, occ_order++, vn};
+    occs[occ_count++] = occ;
+}
+
+static int value_number(AST* expr, AST* parent, int child, int stmt){
+    VNKey k = {get_ast_kind(expr), get_ast_type(expr), 0, 0, -1, -1};
+
+    switch(k.kind){
+        case VAR_USE_NODE:
+            k.data = get_ast_data(expr);
+            k.version = version[(int) k.data];
+            break;
+
+        case BOOL_VAL_NODE:
+        case INT_VAL_NODE:
+        case REAL_VAL_NODE:
+        case STR_VAL_NODE:
+            k.data = get_ast_data(expr);
+            break;
+
+        default:
+            k.data = get_ast_data(expr); // Constant operand of lowered nodes
+            if(get_ast_length(expr) > 0) k.l_vn = value_number(get_ast_child(expr, 0), expr, 0, stmt);
+            if(get_ast_length(expr) > 1) k.r_vn = value_number(get_ast_child(expr, 1), expr, 1, stmt);
+            break;
+    }
+
+    int vn = lookup_vn(&k);
+    if(is_computation(expr)) add_occ(expr, parent, child, stmt, vn);
+    return vn;
+}
+
+static int cmp_occ(const void* a, const void* b){
+    const Occ* x = a;
+    const Occ* y = b;
+    if(x->vn != y->vn) return x->vn - y->vn;
+    if(x->stmt != y->stmt) return x->stmt - y->stmt;
+    return x->order - y->order;
+}
+
+static void touch(AST* ast){
+    int id = get_ast_id(ast);
+    if(id < touched_size) touched[id] = 1;
+    for(int i=0; i<get_ast_length(ast); i++){
+        touch(get_ast_child(ast, i));
+    }
+}
+
+static int is_touched(AST* ast){
+    int id = get_ast_id(ast);
+    return id < touched_size && touched[id];
+}
+
+
+// Rewrite --------------------------------------------------------------------
+
+typedef struct {
+    int first; // Index in occs
+    int count;
+    int size;
+} Class;
+
+static int cmp_class(const void* a, const void* b){
+    return ((const Class*) b)->size - ((const Class*) a)->size;
+}
+
+// Replaces the repeated values found in occs[first..occ_count) by
+// temporaries. Returns the new list, or list itself if nothing changed.
+static AST* rewrite_list(AST* list, int first){
+    int n = occ_count - first;
+    if(n < 2) return list;
+
+    Occ* o = occs + first;
+    qsort(o, n, sizeof(Occ), cmp_occ);
+
+    Class* classes = malloc(n*sizeof(Class));
+    CHECK_PTR_MSG(classes, "Could not allocate memory");
+    int class_count = 0;
+    for(int i=0, j; i<n; i=j){
+        for(j=i+1; j<n && o[j].vn == o[i].vn; j++);
+        if(j-i < 2) continue;
+        Class c = {i, j-i, get_ast_size(o[i].node)};
+        classes[class_count++] = c;
+    }
+
+    // Biggest first: an expression is only moved if nothing around it was.
+    qsort(classes, class_count, sizeof(Class), cmp_class);
+
+    int stmt_count = get_ast_length(list);
+    AST** inserts = calloc(stmt_count, sizeof(AST*)); // A stmt list per position
+    CHECK_PTR_MSG(inserts, "Could not allocate memory");
+    int changed = 0;
+
+    for(int c=0; c<class_count; c++){
+        Occ* co = o + classes[c].first;
+
+        int clean = 1;
+        for(int i=0; i<classes[c].count; i++){
+            if(is_touched(co[i].node)) clean = 0;
+        }
+        if(!clean) continue;
+
+        AST* temp = new_temp_var(get_ast_type(co[0].node));
+        if(!temp) break;
+
+        for(int i=0; i<classes[c].count; i++){
+            touch(co[i].node);
+            set_ast_child(co[i].parent, co[i].child, new_var_use(temp, get_ast_line(co[i].node)));
+        }
+
+        int s = co[0].stmt;
+        if(!inserts[s]) inserts[s] = new_ast_subtree(STMT_LIST_NODE, NULL, 0, NO_TYPE, 0);
+        add_ast_child(inserts[s], new_assign(temp, co[0].node));
+        changed = 1;
+    }
+
+    AST* new_list = list;
+    if(changed){
+        new_list = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(list), NO_TYPE, 0);
+        for(int s=0; s<stmt_count; s++){
+            for(int i=0; inserts[s] && i<get_ast_length(inserts[s]); i++){
+                add_ast_child(new_list, get_ast_child(inserts[s], i));
+            }
+            add_ast_child(new_list, get_ast_child(list, s));
+        }
+    }
+
+    free(inserts);
+    free(classes);
+    return new_list;
+}
+
+static AST* gvn_stmt_list(AST* list, int* changed){
+    if(!list) return NULL;
+
+    int first = occ_count;
+    for(int s=0; s<get_ast_length(list); s++){
+        AST* stmt = get_ast_child(list, s);
+        switch(get_ast_kind(stmt)){
+            case ASSIGN_NODE:
+                value_number(get_ast_child(stmt, 1), stmt, 1, s);
+                kill_var(get_ast_data(get_ast_child(stmt, 0)));
+                break;
+
+            case READ_NODE:
+                kill_var(get_ast_data(get_ast_child(stmt, 0)));
+                break;
+
+            case WRITE_NODE:
+                value_number(get_ast_child(stmt, 0), stmt, 0, s);
+                break;
+
+            case IF_NODE:
+                value_number(get_ast_child(stmt, 0), stmt, 0, s);
+                kill_assigned(stmt);
+                break;
+
+            case REPEAT_NODE:
+                kill_assigned(stmt);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    AST* new_list = rewrite_list(list, first);
+    if(new_list != list) *changed = 1;
+    occ_count = first;
+
+    for(int s=0; s<get_ast_length(new_list); s++){
+        AST* stmt = get_ast_child(new_list, s);
+        NodeKind kind = get_ast_kind(stmt);
+        if(kind == IF_NODE || kind == REPEAT_NODE){
+            for(int i=1; i<get_ast_length(stmt); i++){
+                set_ast_child(stmt, i, gvn_stmt_list(get_ast_child(stmt, i), changed));
+            }
+        }
+    }
+
+    return new_list;
+}
+
+AST* number_values(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    // Each round moves the biggest repeated values; what they contained is
+    // looked at again in the next one.
+    int changed;
+    do{
+        changed = 0;
+        vn_count = 0;
+        occ_count = 0;
+        if(vn_slots) memset(vn_slots, 0, slot_cap*sizeof(int));
+
+        touched_size = get_last_ast_id() + 1;
+        touched = calloc(touched_size, sizeof(char));
+        CHECK_PTR_MSG(touched, "Could not allocate memory");
+
+        set_ast_child(ast, 1, gvn_stmt_list(get_ast_child(ast, 1), &changed));
+
+        free(touched);
+    } while(changed);
+
+    free(vn_keys);
+    free(vn_slots);
+    free(occs);
+    vn_keys = NULL;
+    vn_slots = NULL;
+    occs = NULL;
+    vn_cap = slot_cap = occ_cap = 0;
+
+    return ast;
+}
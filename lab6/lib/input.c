@@ -0,0 +1,386 @@
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "input.h"
+#include "output.h"
+
+// Longest text accepted for a real in batch mode.
+#define REAL_TOKEN_MAX_SIZE 64
+
+typedef enum {
+    TTY_INPUT,
+    BATCH_INPUT,
+    REPLAY_INPUT
+} InputMode;
+
+static InputMode mode = TTY_INPUT;
+static FILE* record_file = NULL;
+
+static char* batch_path = NULL; // NULL means stdin
+static int in_loaded = 0;
+static char* in_data = NULL; // The whole batch input or replay file
+static size_t in_length = 0;
+static size_t in_pos = 0;
+static int in_mapped = 0;
+
+static void exit_on_bad_input(char* msg){
+    printf("RUNTIME ERROR: %s.\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+static void (*bad_input)(char* msg) = exit_on_bad_input;
+
+
+
+// Interactive input
+// ----------------------------------------------------------------------------
+
+static void prompt(char* msg){
+    out_cstr(msg);
+    out_flush();
+}
+
+static int tty_int(){
+    int x;
+    prompt("read (int): ");
+    scanf("%d", &x);
+    return x;
+}
+
+static float tty_real(){
+    float x;
+    prompt("read (real): ");
+    scanf("%f", &x);
+    return x;
+}
+
+static int tty_bool(){
+    int x;
+    do {
+        prompt("read (bool - 0 = false, 1 = true): ");
+        scanf("%d", &x);
+    } while (x != 0 && x != 1);
+    return x;
+}
+
+// Like batch_str, a longer word is cut to size-1 and its rest is dropped.
+static int tty_str(char* buf, int size){
+    char format[32];
+    snprintf(format, sizeof(format), "%%%ds%%*[^ \t\n\r\v\f]", size-1);
+    buf[0] = '\0';
+    prompt("read (str): ");
+    scanf(format, buf);
+    return strlen(buf);
+}
+
+
+
+// Batch input
+// ----------------------------------------------------------------------------
+// Values are parsed straight from the mapped file, the same way scanf would
+// ("%d", "%f", "%s"): skip blanks, then consume the longest valid prefix.
+
+static void load_input(char* path);
+
+static void skip_space(){
+    // Loaded on the first read: a program that reads nothing must not wait
+    // for a stdin that never ends.
+    if(!in_loaded) load_input(batch_path);
+
+    while(in_pos < in_length && isspace((unsigned char) in_data[in_pos])) in_pos++;
+    if(in_pos == in_length) bad_input("unexpected end of the program input");
+}
+
+static int batch_int(){
+    skip_space();
+
+    size_t p = in_pos;
+    int neg = 0;
+    if(in_data[p] == '+' || in_data[p] == '-'){
+        neg = in_data[p] == '-';
+        p++;
+    }
+    if(p == in_length || !isdigit((unsigned char) in_data[p])) bad_input("expected an int in the program input");
+
+    unsigned int u = 0;
+    while(p < in_length && isdigit((unsigned char) in_data[p])){
+        u = u*10 + (in_data[p++] - '0');
+    }
+    in_pos = p;
+    return neg ? (int) (0u - u) : (int) u;
+}
+
+static float batch_real(){
+    skip_space();
+
+    // strtof needs a terminated string and the mapping may not have one.
+    char token[REAL_TOKEN_MAX_SIZE];
+    int n = 0;
+    while(in_pos+n < in_length && n < REAL_TOKEN_MAX_SIZE-1 && !isspace((unsigned char) in_data[in_pos+n])){
+        token[n] = in_data[in_pos+n];
+        n++;
+    }
+    token[n] = '\0';
+
+    char* end;
+    float x = strtof(token, &end);
+    if(end == token) bad_input("expected a real in the program input");
+    in_pos += end - token;
+    return x;
+}
+
+static int batch_bool(){
+    int x;
+    do {
+        x = batch_int();
+    } while (x != 0 && x != 1);
+    return x;
+}
+
+static int batch_str(char* buf, int size){
+    skip_space();
+
+    int n = 0;
+    while(in_pos < in_length && !isspace((unsigned char) in_data[in_pos])){
+        if(n < size-1) buf[n++] = in_data[in_pos];
+        in_pos++;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+static void slurp(int fd){
+    size_t size = INPUT_BLOCK_SIZE;
+    in_data = malloc(size);
+    CHECK_PTR_MSG(in_data, "Could not allocate memory");
+
+    for(;;){
+        if(in_length == size){
+            size *= 2;
+            in_data = realloc(in_data, size);
+            CHECK_PTR_MSG(in_data, "Could not reallocate memory");
+        }
+        ssize_t n = read(fd, in_data+in_length, size-in_length);
+        if(n <= 0) break;
+        in_length += n;
+    }
+}
+
+
+
+// Maps (or reads) the whole file in memory.
+static void load_input(char* path){
+
+    int fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+    if(fd < 0){
+        printf("ERROR: could not open input file '%s'.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat sb;
+    if(fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0){
+        void* data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED){
+            madvise(data, sb.st_size, MADV_SEQUENTIAL);
+            in_data = data;
+            in_length = sb.st_size;
+            in_mapped = 1;
+
+            // A redirected stdin may have been partly consumed already.
+            off_t offset = lseek(fd, 0, SEEK_CUR);
+            if(offset > 0) in_pos = offset;
+        }
+    }
+    if(!in_mapped) slurp(fd);
+
+    if(path) close(fd);
+    in_loaded = 1;
+}
+
+
+
+// Record / replay
+// ----------------------------------------------------------------------------
+// A recording is the REPLAY_MAGIC header followed by one record per value
+// consumed: a tag byte, then a little endian int32 ('i'), float32 ('r'),
+// one byte ('b'), or uint32 length plus the bytes ('s').
+
+static void put_u32(unsigned int u){
+    unsigned char b[4] = {u, u >> 8, u >> 16, u >> 24};
+    fwrite(b, 1, 4, record_file);
+}
+
+static void record_tag(char tag){
+    fputc(tag, record_file);
+}
+
+static void replay_need(size_t n){
+    if(in_length - in_pos < n) bad_input("unexpected end of the replay file");
+}
+
+static void replay_tag(char tag){
+    replay_need(1);
+    if(in_data[in_pos] != tag) bad_input("the replay file does not match the reads of the program");
+    in_pos++;
+}
+
+static unsigned int get_u32(){
+    replay_need(4);
+    unsigned char* b = (unsigned char*) in_data + in_pos;
+    in_pos += 4;
+    return b[0] | b[1] << 8 | b[2] << 16 | (unsigned int) b[3] << 24;
+}
+
+static int replay_int(){
+    replay_tag('i');
+    return (int) get_u32();
+}
+
+static float replay_real(){
+    replay_tag('r');
+    unsigned int u = get_u32();
+    float x;
+    memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+static int replay_bool(){
+    replay_tag('b');
+    replay_need(1);
+    return in_data[in_pos++];
+}
+
+static int replay_str(char* buf, int size){
+    replay_tag('s');
+    size_t length = get_u32();
+    replay_need(length);
+
+    int n = length < (size_t) size ? (int) length : size-1;
+    memcpy(buf, in_data+in_pos, n);
+    buf[n] = '\0';
+    in_pos += length;
+    return n;
+}
+
+
+
+// Input API
+// ----------------------------------------------------------------------------
+
+// Create
+void set_input_error(void (*handler)(char* msg)){
+    bad_input = handler;
+}
+
+void init_input_tty(){
+    mode = TTY_INPUT;
+}
+
+void init_input_batch(char* path){
+    batch_path = path;
+    mode = BATCH_INPUT;
+}
+
+void init_input_replay(char* path){
+    load_input(path);
+    size_t magic_length = strlen(REPLAY_MAGIC);
+    if(in_length < magic_length || memcmp(in_data, REPLAY_MAGIC, magic_length)){
+        printf("ERROR: '%s' is not a recording of program input.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    in_pos = magic_length;
+    mode = REPLAY_INPUT;
+}
+
+void set_input_record(char* path){
+    record_file = fopen(path, "wb");
+    if(!record_file){
+        printf("ERROR: could not open record file '%s'.\n", path);
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(record_file, NULL, _IOFBF, INPUT_BLOCK_SIZE);
+    fputs(REPLAY_MAGIC, record_file);
+}
+
+void free_input(){
+    if(record_file) fclose(record_file);
+    record_file = NULL;
+
+    if(in_mapped) munmap(in_data, in_length);
+    else          free(in_data);
+    in_data = NULL;
+    in_length = in_pos = 0;
+    in_mapped = 0;
+    in_loaded = 0;
+}
+
+
+// Get
+int in_int(){
+    int x;
+    switch(mode){
+        case TTY_INPUT:    x = tty_int();    break;
+        case BATCH_INPUT:  x = batch_int();  break;
+        case REPLAY_INPUT: x = replay_int(); break;
+        default: SWITCH_ERROR(mode);
+    }
+    if(record_file){
+        record_tag('i');
+        put_u32(x);
+    }
+    return x;
+}
+
+float in_real(){
+    float x;
+    switch(mode){
+        case TTY_INPUT:    x = tty_real();    break;
+        case BATCH_INPUT:  x = batch_real();  break;
+        case REPLAY_INPUT: x = replay_real(); break;
+        default: SWITCH_ERROR(mode);
+    }
+    if(record_file){
+        unsigned int u;
+        memcpy(&u, &x, sizeof(u));
+        record_tag('r');
+        put_u32(u);
+    }
+    return x;
+}
+
+int in_bool(){
+    int x;
+    switch(mode){
+        case TTY_INPUT:    x = tty_bool();    break;
+        case BATCH_INPUT:  x = batch_bool();  break;
+        case REPLAY_INPUT: x = replay_bool(); break;
+        default: SWITCH_ERROR(mode);
+    }
+    if(record_file){
+        record_tag('b');
+        fputc(x, record_file);
+    }
+    return x;
+}
+
+int in_str(char* buf, int size){
+    int n;
+    switch(mode){
+        case TTY_INPUT:    n = tty_str(buf, size);    break;
+        case BATCH_INPUT:  n = batch_str(buf, size);  break;
+        case REPLAY_INPUT: n = replay_str(buf, size); break;
+        default: SWITCH_ERROR(mode);
+    }
+    if(record_file){
+        record_tag('s');
+        put_u32(n);
+        fwrite(buf, 1, n, record_file);
+    }
+    return n;
+}
@@ -0,0 +1,30 @@
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "debug.h"
+
+// Program input -------------------------------------
+// Interactive mode (default) prints a prompt and scanf's each value from the
+// terminal. Batch mode reads the whole data file (mmap'd when possible) and
+// tokenizes it in place, with no prompts. Any mode can also record the
+// values it consumes, and replay mode feeds such a recording back.
+#define INPUT_BLOCK_SIZE (1 << 16)
+#define REPLAY_MAGIC "EZLR1\n"
+
+// Create
+void init_input_tty();
+void init_input_batch(char* path); // NULL means stdin
+void init_input_replay(char* path);
+void set_input_record(char* path);
+void set_input_error(void (*handler)(char* msg)); // Missing or bad values, must not return
+void free_input();
+
+// Get
+int in_int();
+float in_real();
+int in_bool();
+int in_str(char* buf, int size); // Returns the length written to buf
+//----------------------------------------------------
+
+#endif // INPUT_H
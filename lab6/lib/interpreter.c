@@ -1,8 +1,14 @@
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "interpreter.h"
+#include "input.h"
+#include "output.h"
+#include "cover.h"
+#include "profile.h"
+#include "sample.h"
 
 // ----------------------------------------------------------------------------
 
@@ -60,8 +66,6 @@ void print_stack() {
 
 // Variables memory -----------------------------------------------------------
 
-#define MEM_SIZE 100
-
 Word mem[MEM_SIZE];
 
 void storei(int addr, int val) {
@@ -88,13 +92,42 @@ void init_mem() {
 
 // ----------------------------------------------------------------------------
 
-// make trace = #define TRACE
+// make trace = #define TRACE, every node run goes to the ring of trace.c
 #ifdef TRACE
-#define trace() printf("TRACE: %s\n", __FUNC__)
+#include "trace.h"
+#define trace() trace_step(ast, sp)
 #else
 #define trace()
 #endif
 
+static AST* run_root = NULL; // For the reports of a run cut short
+
+// Every runtime error ends here: the output so far, then the reports, as
+// after a run to the end.
+static void runtime_error(AST* ast, char* msg){
+    out_flush();
+    printf("RUNTIME ERROR (%d): %s.\n", get_ast_line(ast), msg);
+    fflush(stdout); // Ahead of the report on stderr
+    report_profile(run_root);
+    report_cover(run_root);
+    stop_sampling();
+    exit(EXIT_FAILURE);
+}
+
+// The input fails inside run_read, which is the current statement.
+static void input_error(char* msg){
+    runtime_error(current_node, msg);
+}
+
+// Sampler state: the statement running and the ifs and repeats around it.
+// The condition of an if or repeat runs as the statement itself.
+static void enter_ctrl(AST* ast){
+    if(ctrl_depth < SAMPLE_MAX_DEPTH) ctrl_chain[ctrl_depth] = ast;
+    ctrl_depth++;
+}
+
+#define leave_ctrl() ctrl_depth--
+
 #define MAX_STR_SIZE 128
 static char str_buf[MAX_STR_SIZE];
 #define clear_str_buf() str_buf[0] = '\0'
@@ -102,49 +135,38 @@ static char str_buf[MAX_STR_SIZE];
 void rec_run_ast(AST *ast);
 
 void read_int(int var_idx) {
-    int x;
-    printf("read (int): ");
-    scanf("%d", &x);
-    storei(var_idx, x);
+    storei(var_idx, in_int());
 }
 
 void read_real(int var_idx) {
-    float x;
-    printf("read (real): ");
-    scanf("%f", &x);
-    storef(var_idx, x);
+    storef(var_idx, in_real());
 }
 
 void read_bool(int var_idx) {
-    int x;
-    do {
-        printf("read (bool - 0 = false, 1 = true): ");
-        scanf("%d", &x);
-    } while (x != 0 && x != 1);
-    storei(var_idx, x);
+    storei(var_idx, in_bool());
 }
 
 void read_str(int var_idx) {
-    printf("read (str): ");
-    clear_str_buf();
-    scanf("%s", str_buf);   // Did anyone say Buffer Overflow..? ;P
+    in_str(str_buf, MAX_STR_SIZE);
     storei(var_idx, add_table_str(st, str_buf));
 }
 
 void write_int() {
-    printf("%d\n", popi());
+    out_int(popi());
+    out_char('\n');
 }
 
 void write_real() {
-    printf("%f\n", popf());
+    out_real(popf());
+    out_char('\n');
 }
 
 void write_bool() {
-    popi() == 0 ? printf("false\n") : printf("true\n");
+    popi() == 0 ? out_bytes("false\n", 6) : out_bytes("true\n", 5);
 }
 
-// Helper function to write strings.
-void escape_str(const char* s, char *n) {
+// Helper function to write strings. Returns the length of the result.
+int escape_str(const char* s, char *n) {
     int i = 0, j = 0;
     char c;
     while ((c = s[i++]) != '\0') {
@@ -157,13 +179,14 @@ void escape_str(const char* s, char *n) {
         }
     }
     n[j] = '\0';
+    return j;
 }
 
 void write_str() {
     int s = popi(); // String pointer
     clear_str_buf();
-    escape_str(get_table_str(st, s), str_buf);
-    printf("%s", str_buf); // Weird language semantics, if printing a string, no new line.
+    int length = escape_str(get_table_str(st, s), str_buf);
+    out_bytes(str_buf, length); // Weird language semantics, if printing a string, no new line.
 }
 
 // ----------------------------------------------------------------------------
@@ -181,7 +204,9 @@ void run_assign(AST *ast) {
 void run_stmt_list(AST *ast) {
     trace();
     for(int i=0; i<get_ast_length(ast); i++){
-        rec_run_ast(get_ast_child(ast, i));
+        AST* stmt = get_ast_child(ast, i);
+        current_node = stmt;
+        rec_run_ast(stmt);
     }
 }
 
@@ -220,10 +245,13 @@ void run_if(AST *ast) {
     AST* then_stmt = get_ast_child(ast, 1);
     AST* else_stmt = get_ast_child(ast, 2);
 
+    enter_ctrl(ast);
+    current_node = ast;
     rec_run_ast(expr);
 
     if(popi()) rec_run_ast(then_stmt);
     else       rec_run_ast(else_stmt);
+    leave_ctrl();
 }
 
 // DONE
@@ -271,8 +299,24 @@ void run_over(AST *ast) {
     AST* r_expr = get_ast_child(ast, 1);
     rec_run_ast(r_expr);
     rec_run_ast(l_expr);
-    if(get_ast_type(l_expr) == REAL_TYPE) pushf(popf()/popf());
-    else                                  pushi(popi()/popi());
+    if(get_ast_type(l_expr) == REAL_TYPE){
+        pushf(popf()/popf());
+        return;
+    }
+    int n = popi();
+    int d = popi();
+    if((unsigned) d + 1 > 1) pushi(n/d);      // Neither 0 nor -1
+    else if(d == -1)         pushi(0u - n);   // INT_MIN / -1 wraps around
+    else                     runtime_error(ast, "division by zero");
+}
+
+// Divisor proven neither 0 nor -1 (or the dividend never INT_MIN) by range.c.
+void run_safe_over(AST *ast) {
+    trace();
+    rec_run_ast(get_ast_child(ast, 1));
+    rec_run_ast(get_ast_child(ast, 0));
+    int n = popi();
+    pushi(n/popi());
 }
 
 // DONE
@@ -327,13 +371,16 @@ void run_real_val(AST *ast) {
 // DONE
 void run_repeat(AST *ast) {
     trace();
-    AST* stmt = get_ast_child(ast, 0);
-    AST* expr = get_ast_child(ast, 1);
+    AST* expr = get_ast_child(ast, 0);
+    AST* stmt = get_ast_child(ast, 1);
+    enter_ctrl(ast);
     do{
         rec_run_ast(stmt);
+        current_node = ast;
         rec_run_ast(expr);
     }
-    while(popi());
+    while(!popi());
+    leave_ctrl();
 }
 
 void run_str_val(AST *ast) {
@@ -352,6 +399,81 @@ void run_times(AST *ast) {
     else                                  pushi(popi()*popi());
 }
 
+// The shift count is the right child, a constant.
+void run_shl(AST *ast) {
+    trace();
+    rec_run_ast(get_ast_child(ast, 0));
+    pushi((unsigned) popi() << (int) get_ast_data(get_ast_child(ast, 1)));
+}
+
+// Division by the constant in data. The magic number and the shift are the
+// 2nd and 3rd children, see strength.c.
+void run_div_const(AST *ast) {
+    trace();
+    int d = get_ast_data(ast);
+    int magic = get_ast_data(get_ast_child(ast, 1));
+    int shift = get_ast_data(get_ast_child(ast, 2));
+    rec_run_ast(get_ast_child(ast, 0));
+    int n = popi();
+    int q = ((long long) magic * n) >> 32;
+    if(d > 0 && magic < 0) q = (unsigned) q + n;
+    if(d < 0 && magic > 0) q = (unsigned) q - n;
+    q >>= shift;
+    pushi(q + ((unsigned) q >> 31)); // Truncate toward zero
+}
+
+// Iterations until start + k*step goes past bound, step in data. 0 if the
+// value would wrap around first. See scev.c.
+void run_trip_count(AST *ast) {
+    trace();
+    int step = get_ast_data(ast);
+    rec_run_ast(get_ast_child(ast, 1));
+    rec_run_ast(get_ast_child(ast, 0));
+    long long start = popi();
+    long long bound = popi();
+    long long k = step > 0 ? (bound - start)/step + 1 : (start - bound)/(-step) + 1;
+    if(k < 1) k = 1;
+    long long last = start + k*step;
+    pushi(k > INT_MAX || last > INT_MAX || last < INT_MIN ? 0 : k);
+}
+
+static unsigned long long gcd(unsigned long long a, unsigned long long b) {
+    while(b){
+        unsigned long long t = a%b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// C(k, j), j in data, modulo 2^32 like int products.
+void run_choose(AST *ast) {
+    trace();
+    int j = get_ast_data(ast);
+    rec_run_ast(get_ast_child(ast, 0));
+    long long k = popi();
+    if(k < j){
+        pushi(0);
+        return;
+    }
+
+    // The product of j consecutive numbers divides by j!, one factor of it
+    // at a time, so the division is exact before wrapping.
+    unsigned long long f[j];
+    for(int t = 0; t < j; t++) f[t] = k - t;
+    for(int d = 2; d <= j; d++){
+        unsigned long long g = d;
+        for(int t = 0; t < j; t++){
+            unsigned long long c = gcd(f[t], g);
+            f[t] /= c;
+            g /= c;
+        }
+    }
+    unsigned int c = 1;
+    for(int t = 0; t < j; t++) c *= (unsigned int) f[t];
+    pushi(c);
+}
+
 void run_var_decl(AST *ast) {
     trace();
     // Nothing to do, memory was already cleared upon initialization.
@@ -415,21 +537,61 @@ void run_i2s(AST* ast) {
     trace();
     rec_run_ast(get_ast_child(ast, 0));
     clear_str_buf();
-    sprintf(str_buf, "%d", popi());
+    fmt_int(str_buf, popi());
     pushi(add_table_str(st, str_buf));
 }
 
 void run_r2s(AST* ast) {
+    trace();
     rec_run_ast(get_ast_child(ast, 0));
     clear_str_buf();
-    sprintf(str_buf, "%f", popf());
+    fmt_real(str_buf, popf());
     pushi(add_table_str(st, str_buf));
 }
 
+// Profiling: the first call for a node goes to time_node, which runs it
+// again through here with timed set, so the dispatch stays in one place.
+// inner sums the cycles of the timed nodes run below the current one.
+// Variables and constants are only counted, reading the clock would cost
+// more than running them: their cycles go to their parent's own.
+static AST* timed = NULL;
+static unsigned long long inner = 0;
+
+static void time_node(AST *ast) {
+    int id = get_ast_id(ast);
+    if(get_ast_length(ast) == 0){
+        prof_count[id]++;
+        timed = ast;
+        rec_run_ast(ast);
+        return;
+    }
+
+    unsigned long long outer = inner;
+    inner = 0;
+    unsigned long long start = get_prof_clock();
+    prof_count[id]++;
+    timed = ast;
+    rec_run_ast(ast);
+    unsigned long long cycles = get_prof_clock() - start;
+    prof_cycles[id] += cycles;
+    prof_self[id] += cycles - inner;
+    inner = outer + cycles;
+}
+
 void rec_run_ast(AST *ast) {
     
     if(!ast) return;
 
+    cover_node(ast);
+
+    if(prof_count){
+        if(ast != timed){
+            time_node(ast);
+            return;
+        }
+        timed = NULL;
+    }
+
     NodeKind kind = get_ast_kind(ast);
     switch(kind){
         case PROGRAM_NODE:       run_program(ast);       break;
@@ -447,6 +609,11 @@ void rec_run_ast(AST *ast) {
         case MINUS_NODE:         run_minus(ast);         break;
         case TIMES_NODE:         run_times(ast);         break;
         case OVER_NODE:          run_over(ast);          break;
+        case SHL_NODE:           run_shl(ast);           break;
+        case DIV_CONST_NODE:     run_div_const(ast);     break;
+        case TRIP_COUNT_NODE:    run_trip_count(ast);    break;
+        case CHOOSE_NODE:        run_choose(ast);        break;
+        case SAFE_OVER_NODE:     run_safe_over(ast);     break;
         case VAR_USE_NODE:       run_var_use(ast);       break;
         case BOOL_VAL_NODE:      run_bool_val(ast);      break;
         case INT_VAL_NODE:       run_int_val(ast);       break;
@@ -469,7 +636,13 @@ void rec_run_ast(AST *ast) {
 // ----------------------------------------------------------------------------
 
 void run_ast(AST *ast) {
+    run_root = ast;
+    set_input_error(input_error);
+#ifdef TRACE
+    init_trace();
+#endif
     init_stack();
     init_mem();
+    init_output();
     rec_run_ast(ast);
 }
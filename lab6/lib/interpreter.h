@@ -4,6 +4,9 @@
 #include "ast.h"
 #include "table.h"
 
+// Number of variable slots (the optimizer's temporaries included).
+#define MEM_SIZE 100
+
 void run_ast(AST *ast);
 
 #endif
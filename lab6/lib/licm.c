@@ -0,0 +1,170 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "optimizer.h"
+
+// Loop-invariant code motion
+// ----------------------------------------------------------------------------
+// A computation inside a repeat (body or until condition) whose variables are
+// never written in the loop, by := or read, gives the same value on every
+// iteration. It is computed once into a temporary right before the loop.
+// Only code that runs on every iteration is searched: the body runs at least
+// once, and so do the conditions of the ifs in it and the bodies of nested
+// repeats, but the branches of an if may never run and are left alone.
+// Integer divisions that may trap stay where they are even so: in the
+// prelude they would stop the program before the statements ahead of them.
+// Inner loops are handled first, so their preludes can move out again.
+
+#define HOIST_BLOCK_SIZE 16
+
+typedef struct {
+    AST* expr;  // As computed in the prelude
+    AST* temp;  // Its variable declaration
+} Hoisted;
+
+typedef struct {
+    char assigned[MEM_SIZE];
+    Hoisted* hoisted;
+    int count;
+    AST* prelude; // Statement list run before the loop
+} Loop;
+
+static AST* licm_stmt_list(AST* list);
+
+static int is_invariant(AST* expr, Loop* loop){
+    switch(get_ast_kind(expr)){
+        case VAR_USE_NODE:
+            return !loop->assigned[(int) get_ast_data(expr)];
+
+        case BOOL_VAL_NODE:
+        case INT_VAL_NODE:
+        case REAL_VAL_NODE:
+        case STR_VAL_NODE:
+            return 1;
+
+        default:
+            for(int i=0; i<get_ast_length(expr); i++){
+                if(!is_invariant(get_ast_child(expr, i), loop)) return 0;
+            }
+            return 1;
+    }
+}
+
+// Returns the temporary holding expr, computing it in the prelude if needed.
+static AST* hoist(AST* expr, Loop* loop){
+    for(int i=0; i<loop->count; i++){
+        if(is_same_ast(loop->hoisted[i].expr, expr)) return loop->hoisted[i].temp;
+    }
+
+    AST* temp = new_temp_var(get_ast_type(expr));
+    if(!temp) return NULL;
+
+    if(loop->count%HOIST_BLOCK_SIZE == 0){
+        loop->hoisted = realloc(loop->hoisted, (loop->count+HOIST_BLOCK_SIZE)*sizeof(Hoisted));
+        CHECK_PTR_MSG(loop->hoisted, "Could not reallocate memory");
+    }
+    Hoisted h = {expr, temp};
+    loop->hoisted[loop->count++] = h;
+
+    add_ast_child(loop->prelude, new_assign(temp, expr));
+    return temp;
+}
+
+// Replaces the biggest invariant computations under parent's child i.
+static void hoist_expr(AST* parent, int i, Loop* loop){
+    AST* expr = get_ast_child(parent, i);
+
+    if(is_computation(expr) && is_invariant(expr, loop) && !may_trap(expr)){
+        AST* temp = hoist(expr, loop);
+        if(temp){
+            set_ast_child(parent, i, new_var_use(temp, get_ast_line(expr)));
+            return;
+        }
+    }
+
+    for(int j=0; j<get_ast_length(expr); j++){
+        hoist_expr(expr, j, loop);
+    }
+}
+
+static void hoist_stmt(AST* stmt, Loop* loop){
+    switch(get_ast_kind(stmt)){
+        case ASSIGN_NODE:
+            hoist_expr(stmt, 1, loop);
+            break;
+
+        case WRITE_NODE:
+            hoist_expr(stmt, 0, loop);
+            break;
+
+        case STMT_LIST_NODE:
+            for(int i=0; i<get_ast_length(stmt); i++){
+                hoist_stmt(get_ast_child(stmt, i), loop);
+            }
+            break;
+
+        case IF_NODE:
+            hoist_expr(stmt, 0, loop);
+            break;
+
+        case REPEAT_NODE:
+            hoist_expr(stmt, 0, loop);
+            hoist_stmt(get_ast_child(stmt, 1), loop);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Returns the statements to run before the loop (possibly none).
+static AST* hoist_loop(AST* repeat){
+    Loop loop;
+    memset(loop.assigned, 0, sizeof(loop.assigned));
+    loop.hoisted = NULL;
+    loop.count = 0;
+    loop.prelude = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(repeat), NO_TYPE, 0);
+
+    mark_assigned(repeat, loop.assigned);
+    hoist_stmt(repeat, &loop);
+
+    free(loop.hoisted);
+    return loop.prelude;
+}
+
+static AST* licm_stmt_list(AST* list){
+    if(!list) return NULL;
+
+    AST* new_list = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(list), NO_TYPE, 0);
+
+    for(int s=0; s<get_ast_length(list); s++){
+        AST* stmt = get_ast_child(list, s);
+        NodeKind kind = get_ast_kind(stmt);
+
+        if(kind == IF_NODE || kind == REPEAT_NODE){
+            for(int i=1; i<get_ast_length(stmt); i++){
+                set_ast_child(stmt, i, licm_stmt_list(get_ast_child(stmt, i)));
+            }
+        }
+
+        if(kind == REPEAT_NODE){
+            AST* prelude = hoist_loop(stmt);
+            for(int i=0; i<get_ast_length(prelude); i++){
+                add_ast_child(new_list, get_ast_child(prelude, i));
+            }
+        }
+        add_ast_child(new_list, stmt);
+    }
+
+    return new_list;
+}
+
+AST* hoist_invariants(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    set_ast_child(ast, 1, licm_stmt_list(get_ast_child(ast, 1)));
+    return ast;
+}
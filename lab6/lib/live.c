@@ -0,0 +1,219 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "optimizer.h"
+
+// Liveness
+// ----------------------------------------------------------------------------
+// A variable is live at a point when some path from there reads it before
+// writing it. Computed backward over the statements:
+//   - x := e kills x and makes the variables of e live, but only when x is
+//     live after it: the variables of a dead store stay dead too;
+//   - read x kills x;
+//   - an if joins what is live at the start of each branch;
+//   - a repeat iterates its body until what is live at its start stops
+//     changing, the until condition flowing both out and back to the top.
+//
+// Dead stores: x := e with x not live after it goes away, unless e may trap.
+// Unlike elim_dead_code this sees values overwritten before being read.
+//
+// Slot sharing: two variables interfere when one is written while the other
+// is live (x := y does not make x and y interfere, they hold the same value
+// from there on), or when both are live as the program starts, relying on
+// the cleared memory. Variables that do not interfere get the same slot in
+// mem, greedily in declaration order, and every VAR_USE_NODE is renumbered.
+// Declarations keep the index of their variable in the table. It must run
+// last: the other passes index by variable, not by slot.
+
+typedef struct {
+    int apply;  // Final walk: delete the dead stores, record interference
+    char (*interfere)[MEM_SIZE]; // NULL when only deleting
+} Liveness;
+
+static AST* live_stmt_list(AST* list, char* live, Liveness* l);
+
+static void add_uses(AST* expr, char* live){
+    if(!expr) return;
+    if(get_ast_kind(expr) == VAR_USE_NODE){
+        live[(int) get_ast_data(expr)] = 1;
+        return;
+    }
+    for(int i=0; i<get_ast_length(expr); i++){
+        add_uses(get_ast_child(expr, i), live);
+    }
+}
+
+static void join(char* live, char* other){
+    for(int v=0; v<MEM_SIZE; v++) live[v] |= other[v];
+}
+
+// var is written, 'same' (or -1) holds the same value right after.
+static void kill(int var, int same, char* live, Liveness* l){
+    if(l->apply && l->interfere){
+        for(int v=0; v<MEM_SIZE; v++){
+            if(!live[v] || v == var || v == same) continue;
+            l->interfere[var][v] = 1;
+            l->interfere[v][var] = 1;
+        }
+    }
+    live[var] = 0;
+}
+
+// Returns NULL when stmt is a dead store, the statement otherwise.
+static AST* live_stmt(AST* stmt, char* live, Liveness* l){
+
+    switch(get_ast_kind(stmt)){
+
+        case ASSIGN_NODE: {
+            int var = get_ast_data(get_ast_child(stmt, 0));
+            AST* expr = get_ast_child(stmt, 1);
+            if(!live[var] && !may_trap(expr)) return NULL;
+
+            int same = get_ast_kind(expr) == VAR_USE_NODE ? (int) get_ast_data(expr) : -1;
+            kill(var, same, live, l);
+            add_uses(expr, live);
+            return stmt;
+        }
+
+        case READ_NODE:
+            kill(get_ast_data(get_ast_child(stmt, 0)), -1, live, l);
+            return stmt;
+
+        case WRITE_NODE:
+            add_uses(get_ast_child(stmt, 0), live);
+            return stmt;
+
+        case IF_NODE: {
+            char else_live[MEM_SIZE];
+            memcpy(else_live, live, MEM_SIZE);
+
+            AST* then_list = live_stmt_list(get_ast_child(stmt, 1), live, l);
+            AST* else_list = live_stmt_list(get_ast_child(stmt, 2), else_live, l);
+            join(live, else_live);
+            add_uses(get_ast_child(stmt, 0), live);
+
+            if(l->apply){
+                set_ast_child(stmt, 1, then_list);
+                if(else_list) set_ast_child(stmt, 2, else_list);
+            }
+            return stmt;
+        }
+
+        case REPEAT_NODE: {
+            char exit_live[MEM_SIZE], entry_live[MEM_SIZE] = {0}, body_live[MEM_SIZE];
+            memcpy(exit_live, live, MEM_SIZE);
+            add_uses(get_ast_child(stmt, 0), exit_live);
+
+            int apply = l->apply;
+            l->apply = 0;
+            while(1){
+                memcpy(body_live, exit_live, MEM_SIZE);
+                join(body_live, entry_live);
+                live_stmt_list(get_ast_child(stmt, 1), body_live, l);
+                if(!memcmp(body_live, entry_live, MEM_SIZE)) break;
+                memcpy(entry_live, body_live, MEM_SIZE);
+            }
+            l->apply = apply;
+
+            memcpy(live, exit_live, MEM_SIZE);
+            join(live, entry_live);
+            AST* body = live_stmt_list(get_ast_child(stmt, 1), live, l);
+            if(apply) set_ast_child(stmt, 1, body);
+            return stmt;
+        }
+
+        default:
+            return stmt;
+    }
+}
+
+// Leaves in live what is live at the start of list.
+static AST* live_stmt_list(AST* list, char* live, Liveness* l){
+    if(!list) return NULL;
+
+    int length = get_ast_length(list);
+    char* keep = malloc(length + 1);
+    CHECK_PTR_MSG(keep, "Could not allocate memory");
+
+    int dead = 0;
+    for(int i=length-1; i>=0; i--){
+        keep[i] = live_stmt(get_ast_child(list, i), live, l) != NULL;
+        if(!keep[i]) dead = 1;
+    }
+
+    if(l->apply && dead){
+        AST* new_list = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(list), NO_TYPE, 0);
+        for(int i=0; i<length; i++){
+            if(keep[i]) add_ast_child(new_list, get_ast_child(list, i));
+        }
+        list = new_list;
+    }
+
+    free(keep);
+    return list;
+}
+
+// Returns what is live as the program starts.
+static void run_liveness(AST* program, char* live, Liveness* l){
+    memset(live, 0, MEM_SIZE);
+    l->apply = 1;
+    set_ast_child(program, 1, live_stmt_list(get_ast_child(program, 1), live, l));
+}
+
+AST* elim_dead_stores(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    char live[MEM_SIZE];
+    Liveness l = {0, NULL};
+    run_liveness(ast, live, &l);
+    return ast;
+}
+
+
+// Slot sharing ---------------------------------------------------------------
+
+static void renumber(AST* ast, int* slot){
+    if(!ast) return;
+    if(get_ast_kind(ast) == VAR_USE_NODE){
+        set_ast_data(ast, slot[(int) get_ast_data(ast)]);
+        return;
+    }
+    for(int i=0; i<get_ast_length(ast); i++){
+        renumber(get_ast_child(ast, i), slot);
+    }
+}
+
+AST* share_slots(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    char (*interfere)[MEM_SIZE] = calloc(MEM_SIZE, sizeof(*interfere));
+    CHECK_PTR_MSG(interfere, "Could not allocate memory");
+
+    char live[MEM_SIZE];
+    Liveness l = {0, interfere};
+    run_liveness(ast, live, &l);
+
+    for(int u=0; u<MEM_SIZE; u++){
+        for(int v=0; v<MEM_SIZE; v++){
+            if(live[u] && live[v] && u != v) interfere[u][v] = 1;
+        }
+    }
+
+    int slot[MEM_SIZE];
+    for(int v=0; v<MEM_SIZE; v++){
+        char taken[MEM_SIZE] = {0};
+        for(int u=0; u<v; u++){
+            if(interfere[v][u]) taken[slot[u]] = 1;
+        }
+        slot[v] = 0;
+        while(taken[slot[v]]) slot[v]++;
+    }
+
+    renumber(get_ast_child(ast, 1), slot);
+    free(interfere);
+    return ast;
+}
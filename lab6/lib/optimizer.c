@@ -0,0 +1,224 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "interpreter.h"
+#include "optimizer.h"
+#include "ssa.h"
+
+extern VarTable *vt;
+
+static int opt_level = OPT_LEVEL_DEFAULT;
+static AST* opt_root = NULL; // Program being optimized, holds the declarations
+static int temp_count = 0;
+static char* ssa_dump_path = NULL;
+
+// Driver
+// ----------------------------------------------------------------------------
+
+void set_opt_level(int level){
+    opt_level = level;
+}
+
+void set_ssa_dump(char* path){
+    ssa_dump_path = path;
+}
+
+static AST* run_ssa(AST* ast){
+    SSA* ssa = build_ssa(ast);
+
+    if(ssa_dump_path){
+        FILE* file = fopen(ssa_dump_path, "w");
+        CHECK_PTR_MSG(file, "Could not open the SSA dump file");
+        print_ssa(ssa, file);
+        fclose(file);
+    }
+    if(opt_level >= OPT_LEVEL_SSA) ast = ssa_to_ast(ssa);
+
+    free_ssa(ssa);
+    return ast;
+}
+
+AST* optimize_ast(AST* ast){
+    CHECK_PTR(ast);
+    opt_root = ast;
+    if(opt_level < 1) return ssa_dump_path ? run_ssa(ast) : ast;
+
+    ast = fold_constants(ast);
+    ast = elim_dead_code(ast);
+    ast = elim_dead_stores(ast);
+    ast = solve_recurrences(ast);
+    ast = unswitch_loops(ast);
+    ast = hoist_invariants(ast);
+    ast = unroll_loops(ast);
+    ast = number_values(ast);
+    if(opt_level >= OPT_LEVEL_SSA || ssa_dump_path) ast = run_ssa(ast);
+    ast = reduce_strength(ast);
+    ast = analyze_ranges(ast);
+    ast = share_slots(ast);
+
+    return ast;
+}
+
+
+
+// Helpers
+// ----------------------------------------------------------------------------
+
+int is_const_ast(AST* ast){
+    if(!ast) return 0;
+    switch(get_ast_kind(ast)){
+        case BOOL_VAL_NODE:
+        case INT_VAL_NODE:
+        case REAL_VAL_NODE:
+        case STR_VAL_NODE: return 1;
+        default:           return 0;
+    }
+}
+
+// An operation or conversion worth keeping in a temporary. B2I is a no-op at
+// runtime, reading a temporary would not be cheaper.
+int is_computation(AST* ast){
+    if(!ast) return 0;
+    switch(get_ast_kind(ast)){
+        case LT_NODE:
+        case EQ_NODE:
+        case PLUS_NODE:
+        case MINUS_NODE:
+        case TIMES_NODE:
+        case OVER_NODE:
+        case SHL_NODE:
+        case DIV_CONST_NODE:
+        case SAFE_OVER_NODE:
+        case B2R_NODE:
+        case B2S_NODE:
+        case I2R_NODE:
+        case I2S_NODE:
+        case R2S_NODE: return 1;
+        default:       return 0;
+    }
+}
+
+// Integer division is the only expression that can stop the program (runtime
+// error on division by zero), unless the divisor is a constant other than 0.
+int may_trap(AST* ast){
+    if(!ast) return 0;
+
+    if(get_ast_kind(ast) == OVER_NODE && get_ast_type(get_ast_child(ast, 0)) != REAL_TYPE){
+        AST* divisor = get_ast_child(ast, 1);
+        int safe = get_ast_kind(divisor) == INT_VAL_NODE && get_ast_data(divisor) != 0;
+        if(!safe) return 1;
+    }
+
+    for(int i=0; i<get_ast_length(ast); i++){
+        if(may_trap(get_ast_child(ast, i))) return 1;
+    }
+    return 0;
+}
+
+int is_same_ast(AST* a, AST* b){
+    if(a == b) return 1;
+    if(!a || !b) return 0;
+    if(get_ast_kind(a) != get_ast_kind(b) || get_ast_type(a) != get_ast_type(b)) return 0;
+    if(get_ast_data(a) != get_ast_data(b) || get_ast_length(a) != get_ast_length(b)) return 0;
+    for(int i=0; i<get_ast_length(a); i++){
+        if(!is_same_ast(get_ast_child(a, i), get_ast_child(b, i))) return 0;
+    }
+    return 1;
+}
+
+int get_ast_size(AST* ast){
+    if(!ast) return 0;
+    int size = 1;
+    for(int i=0; i<get_ast_length(ast); i++){
+        size += get_ast_size(get_ast_child(ast, i));
+    }
+    return size;
+}
+
+// Temporaries are declared like user variables, with names the scanner can
+// never produce, so they get a slot in mem and show up in ast.dot.
+AST* new_temp_var(Type type){
+    CHECK_PTR(opt_root);
+    if(get_var_table_length(vt) >= MEM_SIZE) return NULL;
+
+    char name[VARIABLE_MAX_SIZE];
+    sprintf(name, "$t%d", temp_count++);
+
+    AST* var_decl = new_ast(VAR_DECL_NODE, name, 0, type, 0);
+    set_ast_data(var_decl, add_table_var(vt, var_decl));
+    add_ast_child(get_ast_child(opt_root, 0), var_decl);
+    return var_decl;
+}
+
+AST* new_var_use(AST* var_decl, int line){
+    return new_ast(VAR_USE_NODE, get_ast_name(var_decl), line, get_ast_type(var_decl), get_ast_data(var_decl));
+}
+
+AST* new_assign(AST* var_decl, AST* expr){
+    int line = get_ast_line(expr);
+    return new_ast_subtree(ASSIGN_NODE, NULL, line, NO_TYPE, 2, new_var_use(var_decl, line), expr);
+}
+
+void mark_assigned(AST* ast, char* assigned){
+    if(!ast) return;
+
+    switch(get_ast_kind(ast)){
+        case ASSIGN_NODE:
+        case READ_NODE:
+            assigned[(int) get_ast_data(get_ast_child(ast, 0))] = 1;
+            return;
+
+        case STMT_LIST_NODE:
+        case IF_NODE:
+        case REPEAT_NODE:
+            for(int i=0; i<get_ast_length(ast); i++){
+                mark_assigned(get_ast_child(ast, i), assigned);
+            }
+            return;
+
+        default:
+            return; // Expressions never write
+    }
+}
+
+void count_writes(AST* ast, int* writes){
+    switch(get_ast_kind(ast)){
+        case ASSIGN_NODE:
+        case READ_NODE:
+            writes[(int) get_ast_data(get_ast_child(ast, 0))]++;
+            return;
+
+        case STMT_LIST_NODE:
+        case IF_NODE:
+        case REPEAT_NODE:
+            for(int i=0; i<get_ast_length(ast); i++){
+                count_writes(get_ast_child(ast, i), writes);
+            }
+            return;
+
+        default:
+            return;
+    }
+}
+
+// Step of stmt if it is v := v + c or v := v - c, with v an int.
+int get_counter_step(AST* stmt, int* var, int* step){
+    if(get_ast_kind(stmt) != ASSIGN_NODE) return 0;
+
+    AST* target = get_ast_child(stmt, 0);
+    AST* expr = get_ast_child(stmt, 1);
+    NodeKind kind = get_ast_kind(expr);
+    if(get_ast_type(target) != INT_TYPE || (kind != PLUS_NODE && kind != MINUS_NODE)) return 0;
+
+    AST* l = get_ast_child(expr, 0);
+    AST* r = get_ast_child(expr, 1);
+    if(kind == PLUS_NODE && get_ast_kind(l) == INT_VAL_NODE){
+        AST* t = l; l = r; r = t;
+    }
+    if(get_ast_kind(l) != VAR_USE_NODE || get_ast_data(l) != get_ast_data(target)) return 0;
+    if(get_ast_kind(r) != INT_VAL_NODE) return 0;
+
+    *var = get_ast_data(target);
+    *step = kind == PLUS_NODE ? (int) get_ast_data(r) : (int) (0u - (unsigned) get_ast_data(r));
+    return 1;
+}
@@ -0,0 +1,49 @@
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "debug.h"
+#include "ast.h"
+#include "table.h"
+
+// Optimizer -----------------------------------------
+// Passes run on the typed AST between parsing and run_ast. Each one returns
+// the (possibly new) root and leaves a tree the interpreter can execute as is.
+#define OPT_LEVEL_DEFAULT 1
+#define OPT_LEVEL_SSA 2 // Round trip through ssa.c
+
+// Driver
+void set_opt_level(int level);
+void set_unroll_factor(int factor); // unroll.c, 0 picks it per loop
+void set_ssa_dump(char* path);      // Writes the SSA form of the program
+AST* optimize_ast(AST* ast);
+
+// Helpers shared by the passes
+int is_const_ast(AST* ast);
+int is_computation(AST* ast);
+int may_trap(AST* ast);
+int is_same_ast(AST* a, AST* b);
+int get_ast_size(AST* ast);
+AST* new_temp_var(Type type); // NULL when no variable slot is left
+AST* new_var_use(AST* var_decl, int line);
+AST* new_assign(AST* var_decl, AST* expr);
+void mark_assigned(AST* ast, char* assigned); // Vars written by := and read
+void count_writes(AST* ast, int* writes);     // Same, counting the writes
+int get_counter_step(AST* stmt, int* var, int* step); // v := v + c, v := v - c
+
+// Passes
+AST* fold_node(AST* ast);           // fold.c
+AST* fold_constants(AST* ast);      // fold.c
+AST* elim_dead_code(AST* ast);      // dce.c
+AST* number_values(AST* ast);       // gvn.c
+AST* hoist_invariants(AST* ast);    // licm.c
+AST* unswitch_loops(AST* ast);      // unswitch.c
+AST* reduce_strength(AST* ast);     // strength.c
+AST* solve_recurrences(AST* ast);   // scev.c
+AST* unroll_loops(AST* ast);        // unroll.c
+AST* elim_dead_stores(AST* ast);    // live.c
+AST* analyze_ranges(AST* ast);      // range.c
+AST* share_slots(AST* ast);         // live.c, last: renumbers the variables
+//----------------------------------------------------
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,259 @@
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "output.h"
+
+// Output buffer
+// ----------------------------------------------------------------------------
+
+static char out_buf[OUT_BUF_SIZE];
+static int out_length = 0;
+static int out_async = 0;
+
+static void write_all(const char* s, size_t length){
+    while(length > 0){
+        ssize_t n = write(STDOUT_FILENO, s, length);
+        if(n < 0){
+            if(errno == EINTR) continue;
+            return; // Nobody to report to, the output is gone.
+        }
+        s += n;
+        length -= n;
+    }
+}
+
+
+
+// Writer thread
+// ----------------------------------------------------------------------------
+// Single producer (the interpreter) / single consumer (the writer) ring.
+// head and tail only grow, the position in the ring is taken with the mask.
+// Bytes move without locks; the mutex only parks a thread that has nothing
+// to do (empty ring for the writer, full ring or a drain for the producer).
+
+#define RING_MASK (OUT_RING_SIZE - 1)
+
+static char ring[OUT_RING_SIZE];
+static atomic_size_t ring_head = 0; // Written by the interpreter thread
+static atomic_size_t ring_tail = 0; // Written by the writer thread
+static int ring_closing = 0;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+
+static void ring_wake(){
+    pthread_mutex_lock(&ring_lock);
+    pthread_cond_broadcast(&ring_cond);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+static void* writer_main(void* arg){
+    (void) arg;
+    size_t tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+    for(;;){
+        size_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+        if(head == tail){
+            pthread_mutex_lock(&ring_lock);
+            while(atomic_load(&ring_head) == tail && !ring_closing){
+                pthread_cond_wait(&ring_cond, &ring_lock);
+            }
+            int done = ring_closing && atomic_load(&ring_head) == tail;
+            pthread_mutex_unlock(&ring_lock);
+            if(done) return NULL;
+            continue;
+        }
+
+        // Largest contiguous run, the wrapped part goes on the next turn.
+        size_t start = tail & RING_MASK;
+        size_t n = head - tail;
+        if(n > OUT_RING_SIZE - start) n = OUT_RING_SIZE - start;
+        write_all(ring+start, n);
+
+        tail += n;
+        atomic_store_explicit(&ring_tail, tail, memory_order_release);
+        ring_wake();
+    }
+}
+
+static void ring_push(const char* s, size_t length){
+    size_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    while(length > 0){
+        size_t tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+        size_t room = OUT_RING_SIZE - (head - tail);
+        if(room == 0){
+            pthread_mutex_lock(&ring_lock);
+            while(atomic_load(&ring_tail) == tail) pthread_cond_wait(&ring_cond, &ring_lock);
+            pthread_mutex_unlock(&ring_lock);
+            continue;
+        }
+
+        size_t start = head & RING_MASK;
+        size_t n = length;
+        if(n > room) n = room;
+        if(n > OUT_RING_SIZE - start) n = OUT_RING_SIZE - start;
+        memcpy(ring+start, s, n);
+
+        head += n;
+        s += n;
+        length -= n;
+        atomic_store_explicit(&ring_head, head, memory_order_release);
+    }
+    ring_wake();
+}
+
+// Waits until the writer has handed everything to the kernel.
+static void ring_drain(){
+    size_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    pthread_mutex_lock(&ring_lock);
+    while(atomic_load(&ring_tail) != head) pthread_cond_wait(&ring_cond, &ring_lock);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+static void stop_writer(){
+    pthread_mutex_lock(&ring_lock);
+    ring_closing = 1;
+    pthread_cond_broadcast(&ring_cond);
+    pthread_mutex_unlock(&ring_lock);
+    pthread_join(writer, NULL);
+}
+
+
+
+// Output API
+// ----------------------------------------------------------------------------
+
+static void close_output(){
+    out_flush();
+    if(out_async){
+        stop_writer();
+        out_async = 0;
+    }
+}
+
+// Create
+void set_output_async(int on){
+    out_async = on;
+}
+
+void init_output(){
+    // Whatever stdio already holds was printed before the program started.
+    fflush(stdout);
+
+    static int registered = 0;
+    if(!registered){
+        atexit(close_output);
+        registered = 1;
+    }
+    out_length = 0;
+
+    if(out_async && pthread_create(&writer, NULL, writer_main, NULL) != 0){
+        out_async = 0; // No thread, no problem: write synchronously.
+    }
+}
+
+
+// Modify
+
+// Hands the block downstream: to the kernel, or to the writer thread.
+static void out_spill(){
+    if(out_async) ring_push(out_buf, out_length);
+    else          write_all(out_buf, out_length);
+    out_length = 0;
+}
+
+void out_flush(){
+    out_spill();
+    if(out_async) ring_drain();
+}
+
+void out_char(char c){
+    if(out_length == OUT_BUF_SIZE) out_spill();
+    out_buf[out_length++] = c;
+}
+
+void out_bytes(const char* s, int length){
+    while(length > 0){
+        if(out_length == OUT_BUF_SIZE) out_spill();
+        int room = OUT_BUF_SIZE - out_length;
+        int n = length < room ? length : room;
+        memcpy(out_buf+out_length, s, n);
+        out_length += n;
+        s += n;
+        length -= n;
+    }
+}
+
+void out_cstr(const char* s){
+    out_bytes(s, strlen(s));
+}
+
+void out_int(int x){
+    if(OUT_BUF_SIZE - out_length < FMT_NUM_MAX_SIZE) out_spill();
+    out_length += fmt_int(out_buf+out_length, x);
+}
+
+void out_real(float x){
+    if(OUT_BUF_SIZE - out_length < FMT_NUM_MAX_SIZE) out_spill();
+    out_length += fmt_real(out_buf+out_length, x);
+}
+
+
+
+// Number formatting
+// ----------------------------------------------------------------------------
+
+// Writes the decimal digits of u (at least min_digits, zero padded).
+static int fmt_digits(char* dst, unsigned long long u, int min_digits){
+    char tmp[24];
+    int n = 0;
+    do{
+        tmp[n++] = '0' + u%10;
+        u /= 10;
+    } while(u || n < min_digits);
+    for(int i=0; i<n; i++) dst[i] = tmp[n-1-i];
+    return n;
+}
+
+int fmt_int(char* dst, int x){
+    int n = 0;
+    unsigned int u = x;
+    if(x < 0){
+        dst[n++] = '-';
+        u = 0u - u; // Also right for INT_MIN
+    }
+    n += fmt_digits(dst+n, u, 1);
+    dst[n] = '\0';
+    return n;
+}
+
+// Same text as printf("%f", x). A float has a 24 bit significand and 10^6 is
+// 15625*2^6, so x*10^6 is exact as a double and only the final rounding to an
+// integer is left, done half-to-even like glibc does in the default mode.
+int fmt_real(char* dst, float x){
+    double d = x;
+    if(d != d || d >= 1e12 || d <= -1e12){
+        return sprintf(dst, "%f", d); // NaN, inf and huge values
+    }
+
+    int n = 0;
+    if(d < 0 || (d == 0 && 1/d < 0)){
+        dst[n++] = '-';
+        d = -d;
+    }
+
+    double scaled = d * 1e6;
+    unsigned long long u = (unsigned long long) scaled;
+    double rest = scaled - (double) u;
+    if(rest > 0.5 || (rest == 0.5 && (u & 1))) u++;
+
+    n += fmt_digits(dst+n, u/1000000, 1);
+    dst[n++] = '.';
+    n += fmt_digits(dst+n, u%1000000, 6);
+    dst[n] = '\0';
+    return n;
+}
@@ -0,0 +1,38 @@
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "debug.h"
+
+// Buffered program output ---------------------------
+// Everything the EZLang program writes goes through a single large block
+// that is handed to write(2) only when full, before a read prompt waits for
+// the user, or at exit. This avoids the format parsing and stdio locking
+// that printf pays on every call.
+#define OUT_BUF_SIZE (1 << 16)
+
+// In async mode full blocks are copied into a ring drained by a writer
+// thread, so computing and a slow stdout overlap. Must be a power of two.
+#define OUT_RING_SIZE (1 << 20)
+
+// Largest text produced by fmt_int/fmt_real (sign, digits, '.', 6 decimals).
+#define FMT_NUM_MAX_SIZE 64
+
+// Create
+void set_output_async(int on);
+void init_output();
+
+// Modify
+void out_char(char c);
+void out_bytes(const char* s, int length);
+void out_cstr(const char* s);
+void out_int(int x);
+void out_real(float x);
+void out_flush(); // Returns once everything written so far reached stdout
+
+// Format (same text as printf "%d" and "%f"), return the length written
+int fmt_int(char* dst, int x);
+int fmt_real(char* dst, float x);
+//----------------------------------------------------
+
+#endif // OUTPUT_H
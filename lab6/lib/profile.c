@@ -0,0 +1,221 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "output.h"
+#include "profile.h"
+
+unsigned long long* prof_count = NULL;
+unsigned long long* prof_cycles = NULL;
+unsigned long long* prof_self = NULL;
+
+static FILE* report_file = NULL;
+
+static unsigned long long total_cycles = 1; // Of the root, never 0
+static unsigned long long start_cycles = 0;
+
+void init_profile(){
+    int size = get_last_ast_id() + 1;
+    prof_count = calloc(size, sizeof(unsigned long long));
+    prof_cycles = calloc(size, sizeof(unsigned long long));
+    prof_self = calloc(size, sizeof(unsigned long long));
+    CHECK_PTR_MSG(prof_count, "Could not allocate memory");
+    CHECK_PTR_MSG(prof_cycles, "Could not allocate memory");
+    CHECK_PTR_MSG(prof_self, "Could not allocate memory");
+    start_cycles = get_prof_clock();
+}
+
+void free_profile(){
+    free(prof_count);
+    free(prof_cycles);
+    free(prof_self);
+    prof_count = NULL;
+    prof_cycles = NULL;
+    prof_self = NULL;
+}
+
+void set_profile_report(FILE* file){
+    report_file = file;
+}
+
+// Nodes still running when a runtime error ends the run have no cycles yet,
+// the root among them: the total is then the time since init_profile.
+static void set_total(AST* ast){
+    total_cycles = prof_cycles[get_ast_id(ast)];
+    if(!total_cycles) total_cycles = get_prof_clock() - start_cycles;
+    if(!total_cycles) total_cycles = 1;
+}
+
+
+// Report by line -------------------------------------------------------------
+// self adds up the exclusive cycles of every node on the line. runs and
+// total come from the outermost nodes of the line only, those whose parent
+// is on another line, so an expression is not counted again inside its
+// statement. The program and the lists have no line (0): only their own
+// cycles go to the "-" row, their children count as under the parent.
+
+typedef struct {
+    int line;
+    unsigned long long runs;
+    unsigned long long self;
+    unsigned long long total;
+} LineCost;
+
+typedef struct {
+    LineCost* costs; // By line
+    int size;
+} LineTable;
+
+static void add_line_costs(AST* ast, int parent_line, LineTable* table, char* visited){
+    int id = get_ast_id(ast);
+    if(visited[id]) return;
+    visited[id] = 1;
+
+    int line = get_ast_line(ast);
+    if(line >= table->size){
+        int size = table->size;
+        while(line >= table->size) table->size += PROFILE_LINES_SIZE;
+        table->costs = realloc(table->costs, table->size*sizeof(LineCost));
+        CHECK_PTR_MSG(table->costs, "Could not reallocate memory");
+        for(int l=size; l<table->size; l++) table->costs[l] = (LineCost){l, 0, 0, 0};
+    }
+
+    LineCost* cost = &table->costs[line];
+    cost->self += prof_self[id];
+    if(!line) line = parent_line;
+    else if(line != parent_line){
+        cost->runs += prof_count[id];
+        cost->total += prof_cycles[id];
+    }
+
+    for(int i=0; i<get_ast_length(ast); i++){
+        AST* child = get_ast_child(ast, i);
+        if(child) add_line_costs(child, line, table, visited);
+    }
+}
+
+static int by_self(const void* a, const void* b){
+    const LineCost* x = a;
+    const LineCost* y = b;
+    if(x->self != y->self) return x->self < y->self ? 1 : -1;
+    return x->line - y->line;
+}
+
+void report_profile(AST* ast){
+    if(!report_file || !prof_count || !ast) return;
+    out_flush(); // The program's output first
+    set_total(ast);
+
+    char* visited = calloc(get_last_ast_id() + 1, sizeof(char));
+    CHECK_PTR_MSG(visited, "Could not allocate memory");
+    LineTable table = {NULL, 0};
+    add_line_costs(ast, -1, &table, visited);
+    qsort(table.costs, table.size, sizeof(LineCost), by_self);
+
+    fprintf(report_file, "PROFILE: %llu cycles, by line, costliest first%s\n", total_cycles,
+            prof_cycles[get_ast_id(ast)] ? "" : " (run cut short, the lines running miss their last run)");
+    fprintf(report_file, "%6s %12s %14s %7s %14s %7s\n", "line", "runs", "self", "self%", "total", "total%");
+    for(int l=0; l<table.size; l++){
+        LineCost* cost = &table.costs[l];
+        if(!cost->runs && !cost->self) continue;
+        if(!cost->line){
+            fprintf(report_file, "%6s %12s %14llu %6.2f%% %14s %7s\n", "-", "-",
+                    cost->self, 100.0*cost->self/total_cycles, "-", "-");
+            continue;
+        }
+        fprintf(report_file, "%6d %12llu %14llu %6.2f%% %14llu %6.2f%%\n", cost->line, cost->runs,
+                cost->self, 100.0*cost->self/total_cycles, cost->total, 100.0*cost->total/total_cycles);
+    }
+
+    free(table.costs);
+    free(visited);
+    report_file = NULL; // Once, a runtime error may come after the run
+}
+
+
+// Dot ------------------------------------------------------------------------
+// Nodes are filled from white to red by their share of the run, children
+// included, so the hot path stands out from the root down. Nodes that never
+// ran are dashed. The edge from a repeat to its body counts the iterations.
+
+static void label_profile(AST* node, FILE* file){
+    int id = get_ast_id(node);
+    if(!prof_count[id]) return;
+    fprintf(file, "\\n%llux, %.1f%%", prof_count[id], 100.0*prof_cycles[id]/total_cycles);
+}
+
+static void attrs_profile(AST* node, FILE* file){
+    int id = get_ast_id(node);
+    if(!prof_count[id]){
+        fprintf(file, ", style=dashed, fontcolor=gray");
+        return;
+    }
+    fprintf(file, ", style=filled, fillcolor=\"0.000 %.3f 1.000\"", (double) prof_cycles[id]/total_cycles);
+}
+
+static void edge_profile(AST* parent, int i, FILE* file){
+    if(get_ast_kind(parent) != REPEAT_NODE || i != 1) return;
+    unsigned long long entries = prof_count[get_ast_id(parent)];
+    unsigned long long iterations = prof_count[get_ast_id(get_ast_child(parent, 1))];
+    fprintf(file, "[label=\"%llu iterations", iterations);
+    if(entries > 1) fprintf(file, "\\n%.1f per entry", (double) iterations/entries);
+    fprintf(file, "\", penwidth=2]");
+}
+
+void gen_profile_dot(AST* ast, char* path, int max_depth){
+    CHECK_PTR(ast);
+    CHECK_PTR_MSG(prof_count, "No profile to write");
+    set_total(ast);
+    DotStyle style = {label_profile, attrs_profile, edge_profile};
+    gen_ast_styled_dot(ast, path, max_depth, &style);
+}
+
+
+// JSON -----------------------------------------------------------------------
+// {"cycles":<root>,"nodes":[<node>,...]}, one node per line, each written
+// once even when shared:
+//   {"id":3,"kind":"repeat","line":5,"count":1,"cycles":9120,"self":480,"iterations":100,"children":[4,9]}
+// cycles with the children, self without, iterations only for repeat nodes.
+
+static void write_json_node(AST* ast, FILE* file, char* visited, int* first){
+    int id = get_ast_id(ast);
+    if(visited[id]) return;
+    visited[id] = 1;
+
+    fprintf(file, "%s\n{\"id\":%d,\"kind\":\"%s\",\"line\":%d,\"count\":%llu,\"cycles\":%llu,\"self\":%llu",
+            *first ? "" : ",", id, get_kind_str(get_ast_kind(ast)), get_ast_line(ast), prof_count[id], prof_cycles[id], prof_self[id]);
+    *first = 0;
+    if(get_ast_kind(ast) == REPEAT_NODE){
+        fprintf(file, ",\"iterations\":%llu", prof_count[get_ast_id(get_ast_child(ast, 1))]);
+    }
+
+    fprintf(file, ",\"children\":[");
+    for(int i=0; i<get_ast_length(ast); i++){
+        AST* child = get_ast_child(ast, i);
+        if(child) fprintf(file, "%s%d", i ? "," : "", get_ast_id(child));
+    }
+    fprintf(file, "]}");
+
+    for(int i=0; i<get_ast_length(ast); i++){
+        AST* child = get_ast_child(ast, i);
+        if(child) write_json_node(child, file, visited, first);
+    }
+}
+
+void gen_profile_json(AST* ast, char* path){
+    CHECK_PTR(ast);
+    CHECK_PTR_MSG(prof_count, "No profile to write");
+    FILE* file = fopen(path, "w");
+    CHECK_PTR_MSG(file, "Could not open the profile file");
+    setvbuf(file, NULL, _IOFBF, AST_DOT_BUF_SIZE);
+
+    char* visited = calloc(get_last_ast_id() + 1, sizeof(char));
+    CHECK_PTR_MSG(visited, "Could not allocate memory");
+
+    int first = 1;
+    fprintf(file, "{\"cycles\":%llu,\"nodes\":[", prof_cycles[get_ast_id(ast)]);
+    write_json_node(ast, file, visited, &first);
+    fprintf(file, "\n]}\n");
+
+    free(visited);
+    fclose(file);
+}
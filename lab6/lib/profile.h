@@ -0,0 +1,49 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include "debug.h"
+#include "ast.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Execution profile ---------------------------------
+// Counters of an instrumented run, indexed by node id: how many times
+// rec_run_ast ran each node and the cycles spent in it, with and without
+// its children. They only exist when a profile output was asked for;
+// otherwise the interpreter pays one test of prof_count per node.
+#define PROFILE_LINES_SIZE 64 // Line table grows by this
+
+extern unsigned long long* prof_count;  // NULL when not profiling
+extern unsigned long long* prof_cycles; // Inclusive
+extern unsigned long long* prof_self;   // Exclusive
+
+// Create
+void init_profile(); // Once the tree is final, after optimize_ast
+void free_profile();
+
+// Modify
+void set_profile_report(FILE* file); // Where report_profile writes, NULL for nowhere
+
+// Get
+static inline unsigned long long get_prof_clock(){
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec*1000000000ull + t.tv_nsec;
+#endif
+}
+
+// Output
+void report_profile(AST* ast); // Cost by source line, costliest first
+void gen_profile_dot(AST* ast, char* path, int max_depth); // Heat map of the AST
+void gen_profile_json(AST* ast, char* path);
+//----------------------------------------------------
+
+#endif // PROFILE_H
@@ -0,0 +1,355 @@
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "optimizer.h"
+
+// Range analysis
+// ----------------------------------------------------------------------------
+// Abstract interpretation of the int variables over intervals, every variable
+// starting at [0, 0] (cleared memory). Arithmetic is done on the bounds in 64
+// bits; a result that may wrap around is unknown. An if splits on its
+// condition (x < e, e < x, x = e narrow x), a repeat is iterated from its
+// entry until its header is stable, widening a growing bound to the next
+// constant the program compares with (+-1) for THRESHOLD_STEPS iterations,
+// then to the int limit, and narrowing back NARROW_STEPS times.
+//
+// An integer division whose divisor is never 0, and never -1 when the
+// dividend may be INT_MIN, becomes SAFE_OVER_NODE, which run_over's checks
+// are skipped for.
+
+#define WIDEN_DELAY 2
+#define THRESHOLD_STEPS 8
+#define NARROW_STEPS 2
+#define THRESHOLD_BLOCK_SIZE 16
+
+typedef struct {
+    long long lo, hi;
+} Range;
+
+typedef struct {
+    int dead; // No execution gets here
+    Range vars[MEM_SIZE];
+} State;
+
+static long long* thresholds = NULL; // Sorted
+static int threshold_count = 0;
+
+static void range_stmt_list(AST* list, State* s, int apply);
+
+
+// Intervals ------------------------------------------------------------------
+
+static Range make(long long lo, long long hi){
+    Range r = {lo, hi};
+    if(lo < INT_MIN || hi > INT_MAX){
+        r.lo = INT_MIN;
+        r.hi = INT_MAX;
+    }
+    return r;
+}
+
+static Range top(){
+    return make(INT_MIN, INT_MAX);
+}
+
+static int contains(Range r, long long x){
+    return r.lo <= x && x <= r.hi;
+}
+
+static long long min4(long long a, long long b, long long c, long long d){
+    long long m = a < b ? a : b;
+    if(c < m) m = c;
+    return d < m ? d : m;
+}
+
+static long long max4(long long a, long long b, long long c, long long d){
+    long long m = a > b ? a : b;
+    if(c > m) m = c;
+    return d > m ? d : m;
+}
+
+static Range range_div(Range n, Range d){
+    if(d.lo > 0 || d.hi < 0){ // Monotonic in both operands
+        long long a = n.lo/d.lo, b = n.lo/d.hi, c = n.hi/d.lo, e = n.hi/d.hi;
+        return make(min4(a, b, c, e), max4(a, b, c, e));
+    }
+    long long m = -n.lo > n.hi ? -n.lo : n.hi;
+    return make(-m, m);
+}
+
+static Range eval(AST* expr, State* s){
+    Range l, r;
+    NodeKind kind = get_ast_kind(expr);
+
+    switch(kind){
+        case INT_VAL_NODE:
+        case BOOL_VAL_NODE:
+            return make(get_ast_data(expr), get_ast_data(expr));
+
+        case VAR_USE_NODE:
+            if(get_ast_type(expr) == BOOL_TYPE) return make(0, 1);
+            if(get_ast_type(expr) != INT_TYPE) return top();
+            return s->vars[(int) get_ast_data(expr)];
+
+        case B2I_NODE:
+        case LT_NODE:
+        case EQ_NODE:
+            return make(0, 1);
+
+        case PLUS_NODE:
+        case MINUS_NODE:
+        case TIMES_NODE:
+        case OVER_NODE:
+        case SAFE_OVER_NODE:
+            if(get_ast_type(expr) != INT_TYPE) return top();
+            l = eval(get_ast_child(expr, 0), s);
+            r = eval(get_ast_child(expr, 1), s);
+            if(kind == PLUS_NODE)  return make(l.lo + r.lo, l.hi + r.hi);
+            if(kind == MINUS_NODE) return make(l.lo - r.hi, l.hi - r.lo);
+            if(kind != TIMES_NODE) return range_div(l, r);
+            return make(min4(l.lo*r.lo, l.lo*r.hi, l.hi*r.lo, l.hi*r.hi),
+                        max4(l.lo*r.lo, l.lo*r.hi, l.hi*r.lo, l.hi*r.hi));
+
+        case SHL_NODE:
+            l = eval(get_ast_child(expr, 0), s);
+            return make(l.lo * (1LL << (int) get_ast_data(get_ast_child(expr, 1))),
+                        l.hi * (1LL << (int) get_ast_data(get_ast_child(expr, 1))));
+
+        case DIV_CONST_NODE:
+            return range_div(eval(get_ast_child(expr, 0), s), make(get_ast_data(expr), get_ast_data(expr)));
+
+        default:
+            return top();
+    }
+}
+
+
+// States ---------------------------------------------------------------------
+
+static void join(State* s, State* other){
+    if(other->dead) return;
+    if(s->dead){
+        *s = *other;
+        return;
+    }
+    for(int v=0; v<MEM_SIZE; v++){
+        if(other->vars[v].lo < s->vars[v].lo) s->vars[v].lo = other->vars[v].lo;
+        if(other->vars[v].hi > s->vars[v].hi) s->vars[v].hi = other->vars[v].hi;
+    }
+}
+
+static int is_same_state(State* a, State* b){
+    if(a->dead || b->dead) return a->dead == b->dead;
+    return !memcmp(a->vars, b->vars, sizeof(a->vars));
+}
+
+static long long widen_lo(long long old, long long lo, int use_thresholds){
+    if(lo >= old) return old;
+    for(int i=threshold_count-1; use_thresholds && i>=0; i--){
+        if(thresholds[i] <= lo) return thresholds[i];
+    }
+    return INT_MIN;
+}
+
+static long long widen_hi(long long old, long long hi, int use_thresholds){
+    if(hi <= old) return old;
+    for(int i=0; use_thresholds && i<threshold_count; i++){
+        if(thresholds[i] >= hi) return thresholds[i];
+    }
+    return INT_MAX;
+}
+
+static void widen(State* old, State* s, int use_thresholds){
+    if(old->dead || s->dead) return;
+    for(int v=0; v<MEM_SIZE; v++){
+        s->vars[v].lo = widen_lo(old->vars[v].lo, s->vars[v].lo, use_thresholds);
+        s->vars[v].hi = widen_hi(old->vars[v].hi, s->vars[v].hi, use_thresholds);
+    }
+}
+
+// Narrows the variable expr is, if it is one, to [lo, hi].
+static void narrow(AST* expr, long long lo, long long hi, State* s){
+    if(get_ast_kind(expr) != VAR_USE_NODE || get_ast_type(expr) != INT_TYPE) return;
+
+    Range* r = &s->vars[(int) get_ast_data(expr)];
+    if(lo > r->lo) r->lo = lo;
+    if(hi < r->hi) r->hi = hi;
+    if(r->lo > r->hi) s->dead = 1;
+}
+
+// Keeps in s the executions where cond is 'truth'.
+static void assume(AST* cond, int truth, State* s){
+    if(s->dead) return;
+
+    NodeKind kind = get_ast_kind(cond);
+    if(kind != LT_NODE && kind != EQ_NODE) return;
+
+    AST* l = get_ast_child(cond, 0);
+    AST* r = get_ast_child(cond, 1);
+    if(get_ast_type(l) != INT_TYPE) return;
+    Range lr = eval(l, s);
+    Range rr = eval(r, s);
+
+    if(kind == LT_NODE && truth){
+        narrow(l, INT_MIN, rr.hi - 1, s);
+        narrow(r, lr.lo + 1, INT_MAX, s);
+    }
+    else if(kind == LT_NODE){
+        narrow(l, rr.lo, INT_MAX, s);
+        narrow(r, INT_MIN, lr.hi, s);
+    }
+    else if(truth){
+        narrow(l, rr.lo, rr.hi, s);
+        narrow(r, lr.lo, lr.hi, s);
+    }
+    else if(rr.lo == rr.hi && get_ast_kind(l) == VAR_USE_NODE){
+        if(lr.lo == rr.lo) narrow(l, lr.lo + 1, INT_MAX, s);
+        if(lr.hi == rr.lo) narrow(l, INT_MIN, lr.hi - 1, s);
+    }
+}
+
+
+// Statements -----------------------------------------------------------------
+
+// Replaces the divisions s proves safe.
+static AST* mark_safe(AST* expr, State* s){
+    for(int i=0; i<get_ast_length(expr); i++){
+        set_ast_child(expr, i, mark_safe(get_ast_child(expr, i), s));
+    }
+    if(s->dead || get_ast_kind(expr) != OVER_NODE || get_ast_type(expr) != INT_TYPE) return expr;
+
+    Range n = eval(get_ast_child(expr, 0), s);
+    Range d = eval(get_ast_child(expr, 1), s);
+    if(contains(d, 0) || (contains(d, -1) && contains(n, INT_MIN))) return expr;
+
+    return new_ast_subtree(SAFE_OVER_NODE, NULL, get_ast_line(expr), INT_TYPE, 2,
+                           get_ast_child(expr, 0), get_ast_child(expr, 1));
+}
+
+static void range_stmt(AST* stmt, State* s, int apply){
+    if(s->dead) return;
+
+    switch(get_ast_kind(stmt)){
+
+        case ASSIGN_NODE: {
+            AST* var_use = get_ast_child(stmt, 0);
+            if(apply) set_ast_child(stmt, 1, mark_safe(get_ast_child(stmt, 1), s));
+            if(get_ast_type(var_use) == INT_TYPE) s->vars[(int) get_ast_data(var_use)] = eval(get_ast_child(stmt, 1), s);
+            return;
+        }
+
+        case READ_NODE: {
+            AST* var_use = get_ast_child(stmt, 0);
+            if(get_ast_type(var_use) == INT_TYPE) s->vars[(int) get_ast_data(var_use)] = top();
+            return;
+        }
+
+        case WRITE_NODE:
+            if(apply) set_ast_child(stmt, 0, mark_safe(get_ast_child(stmt, 0), s));
+            return;
+
+        case IF_NODE: {
+            if(apply) set_ast_child(stmt, 0, mark_safe(get_ast_child(stmt, 0), s));
+            State else_state = *s;
+            assume(get_ast_child(stmt, 0), 1, s);
+            assume(get_ast_child(stmt, 0), 0, &else_state);
+            range_stmt_list(get_ast_child(stmt, 1), s, apply);
+            range_stmt_list(get_ast_child(stmt, 2), &else_state, apply);
+            join(s, &else_state);
+            return;
+        }
+
+        case REPEAT_NODE: {
+            AST* cond = get_ast_child(stmt, 0);
+            AST* body = get_ast_child(stmt, 1);
+            State header = *s, next;
+
+            for(int i=0; ; i++){
+                next = header;
+                range_stmt_list(body, &next, 0);
+                assume(cond, 0, &next);
+                join(&next, s);
+                if(i >= WIDEN_DELAY) widen(&header, &next, i < WIDEN_DELAY + THRESHOLD_STEPS);
+                if(is_same_state(&header, &next)) break;
+                header = next;
+            }
+            for(int i=0; i<NARROW_STEPS; i++){
+                next = header;
+                range_stmt_list(body, &next, 0);
+                assume(cond, 0, &next);
+                join(&next, s);
+                header = next;
+            }
+
+            *s = header;
+            range_stmt_list(body, s, apply);
+            if(apply) set_ast_child(stmt, 0, mark_safe(cond, s));
+            assume(get_ast_child(stmt, 0), 1, s);
+            return;
+        }
+
+        default:
+            return;
+    }
+}
+
+static void range_stmt_list(AST* list, State* s, int apply){
+    for(int i=0; list && i<get_ast_length(list); i++){
+        range_stmt(get_ast_child(list, i), s, apply);
+    }
+}
+
+
+// Driver ---------------------------------------------------------------------
+
+static void add_threshold(long long x){
+    if(x < INT_MIN || x > INT_MAX) return;
+
+    int i = 0;
+    while(i < threshold_count && thresholds[i] < x) i++;
+    if(i < threshold_count && thresholds[i] == x) return;
+
+    if(threshold_count%THRESHOLD_BLOCK_SIZE == 0){
+        thresholds = realloc(thresholds, (threshold_count+THRESHOLD_BLOCK_SIZE)*sizeof(long long));
+        CHECK_PTR_MSG(thresholds, "Could not reallocate memory");
+    }
+    memmove(&thresholds[i+1], &thresholds[i], (threshold_count-i)*sizeof(long long));
+    thresholds[i] = x;
+    threshold_count++;
+}
+
+// Constants compared with, the bounds a loop stops at.
+static void find_thresholds(AST* ast){
+    NodeKind kind = get_ast_kind(ast);
+
+    for(int i=0; i<get_ast_length(ast); i++){
+        AST* child = get_ast_child(ast, i);
+        if((kind == LT_NODE || kind == EQ_NODE) && get_ast_kind(child) == INT_VAL_NODE){
+            long long x = get_ast_data(child);
+            add_threshold(x - 1);
+            add_threshold(x);
+            add_threshold(x + 1);
+        }
+        find_thresholds(child);
+    }
+}
+
+AST* analyze_ranges(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    find_thresholds(get_ast_child(ast, 1));
+
+    State* s = calloc(1, sizeof(State)); // Everything [0, 0]
+    CHECK_PTR_MSG(s, "Could not allocate memory");
+    range_stmt_list(get_ast_child(ast, 1), s, 1);
+
+    free(s);
+    free(thresholds);
+    thresholds = NULL;
+    threshold_count = 0;
+    return ast;
+}
@@ -0,0 +1,103 @@
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include "sample.h"
+
+AST* volatile current_node = NULL;
+AST* volatile ctrl_chain[SAMPLE_MAX_DEPTH];
+volatile int ctrl_depth = 0;
+
+// One stack: the control statements around the sampled node, then its line.
+typedef struct {
+    unsigned long long count; // 0: free
+    int line;
+    int depth;
+    AST* chain[SAMPLE_MAX_DEPTH];
+} Stack;
+
+static Stack* stacks = NULL;
+static int stack_count = 0;
+static unsigned long long dropped = 0; // Samples not counted, table full
+static char* folded_path = NULL;
+
+// Runs in the signal handler: no allocation, no stdio.
+static void take_sample(int sig){
+    (void) sig;
+    AST* node = current_node;
+    if(!node) return;
+
+    int line = get_ast_line(node);
+    int depth = ctrl_depth < SAMPLE_MAX_DEPTH ? ctrl_depth : SAMPLE_MAX_DEPTH;
+    unsigned h = 2166136261u ^ line; // FNV-1a over the line and the chain
+    for(int d=0; d<depth; d++) h = (h ^ (unsigned) get_ast_id(ctrl_chain[d])) * 16777619u;
+
+    for(int i = h & (SAMPLE_TABLE_SIZE-1); ; i = (i+1) & (SAMPLE_TABLE_SIZE-1)){
+        Stack* s = &stacks[i];
+        if(!s->count){
+            if(4*stack_count >= 3*SAMPLE_TABLE_SIZE){
+                dropped++;
+                return;
+            }
+            s->line = line;
+            s->depth = depth;
+            for(int d=0; d<depth; d++) s->chain[d] = ctrl_chain[d];
+            s->count = 1;
+            stack_count++;
+            return;
+        }
+        if(s->line != line || s->depth != depth) continue;
+
+        int d = 0;
+        while(d < depth && s->chain[d] == ctrl_chain[d]) d++;
+        if(d == depth){
+            s->count++;
+            return;
+        }
+    }
+}
+
+void start_sampling(char* path){
+    stacks = calloc(SAMPLE_TABLE_SIZE, sizeof(Stack));
+    CHECK_PTR_MSG(stacks, "Could not allocate memory");
+    folded_path = path;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = take_sample;
+    action.sa_flags = SA_RESTART; // Reads go on after a sample
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+
+    struct itimerval timer = {{0, SAMPLE_INTERVAL_US}, {0, SAMPLE_INTERVAL_US}};
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void stop_sampling(){
+    if(!stacks) return;
+
+    struct itimerval timer = {{0, 0}, {0, 0}};
+    setitimer(ITIMER_PROF, &timer, NULL);
+    signal(SIGPROF, SIG_IGN);
+
+    FILE* file = fopen(folded_path, "w");
+    CHECK_PTR_MSG(file, "Could not open the samples file");
+    for(int i=0; i<SAMPLE_TABLE_SIZE; i++){
+        Stack* s = &stacks[i];
+        if(!s->count) continue;
+        fprintf(file, "program");
+        for(int d=0; d<s->depth; d++){
+            AST* ctrl = s->chain[d];
+            fprintf(file, ";%s line %d", get_kind_str(get_ast_kind(ctrl)), get_ast_line(ctrl));
+        }
+        if(s->line) fprintf(file, ";line %d", s->line); // 0: none
+        fprintf(file, " %llu\n", s->count);
+    }
+    if(dropped) fprintf(file, "program;(dropped, too many stacks) %llu\n", dropped);
+    fclose(file);
+
+    free(stacks);
+    stacks = NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include "debug.h"
+#include "ast.h"
+
+// Sampling profiler ---------------------------------
+// SIGPROF fires every SAMPLE_INTERVAL_US of CPU time and the handler counts
+// the statement running under the chain of ifs and repeats around it, in a
+// table allocated beforehand. At the end the counts are written as folded
+// stacks, one frame per control statement and the line last, for
+// flamegraph.pl:
+//   program;repeat line 16;repeat line 14;line 12 1523
+// The interpreter keeps current_node and the chain up to date in every run,
+// sampling or not: a store per statement and per condition tested, and a
+// push and pop per if or repeat. Expressions are not tracked, they run on
+// the line of their statement.
+#define SAMPLE_INTERVAL_US 1000
+#define SAMPLE_MAX_DEPTH 32       // Deeper control statements are left out
+#define SAMPLE_TABLE_SIZE (1 << 14) // Power of two, distinct stacks
+
+extern AST* volatile current_node;
+extern AST* volatile ctrl_chain[SAMPLE_MAX_DEPTH];
+extern volatile int ctrl_depth;   // May pass SAMPLE_MAX_DEPTH
+
+// Create
+void start_sampling(char* path); // Writes the folded stacks there at stop_sampling
+void stop_sampling();            // Once the run ended, the tree still alive
+//----------------------------------------------------
+
+#endif // SAMPLE_H
@@ -0,0 +1,373 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "optimizer.h"
+
+// Closed forms of counting loops
+// ----------------------------------------------------------------------------
+// A repeat whose body is only updates v := v + e (or v - e) of int variables,
+// one per variable, computes polynomials of the iteration count. Each value
+// is kept as a chain of recurrences: after m iterations v is
+//   coef[0] + coef[1]*C(m,1) + ... + coef[d]*C(m,d)
+// with coefficients built from the values on entry. An update moves e one
+// degree up: v's coefficients are v itself, then e's. Reading a variable
+// already updated in this iteration reads it one iteration later, a shift
+// of its chain. Variables feeding on each other (x := x + y; y := y + x)
+// are not polynomials and leave the loop alone.
+//
+// If the until condition compares an invariant with a chain of degree 1
+// moving toward it (n < i with i going up, i < n with i going down), the
+// trip count k comes from TRIP_COUNT_NODE and the loop becomes
+//   $k := trip count; if $k = 0 then <the loop> else <values after k> end
+// TRIP_COUNT_NODE gives 0 when the variable would wrap around before
+// reaching the bound, the loop then runs as written. C(k,j) is CHOOSE_NODE,
+// modulo 2^32 like every int product, so the results wrap exactly as the
+// loop would.
+
+#define CR_MAX_DEGREE 4
+
+extern VarTable *vt;
+
+typedef struct {
+    AST* coef[CR_MAX_DEGREE+1]; // May share subtrees, copied when emitted
+    int degree;
+} CR;
+
+typedef struct {
+    AST* target; // v in v := v + e
+    AST* step;   // e
+    int negate;  // v := v - e
+    int pos;     // Index of the update in the body
+    int state;   // 0 unsolved, 1 being solved, 2 solved
+    CR cr;
+} Rec;
+
+typedef struct {
+    Rec* recs;
+    int rec_of[MEM_SIZE]; // Index in recs by variable, -1 if not updated
+    int line;
+} Loop;
+
+
+// Chains of recurrences ------------------------------------------------------
+
+static int is_int_const(AST* ast, int x){
+    return get_ast_kind(ast) == INT_VAL_NODE && (int) get_ast_data(ast) == x;
+}
+
+static AST* new_int(int line, int x){
+    return new_ast(INT_VAL_NODE, NULL, line, INT_TYPE, x);
+}
+
+// Coefficients never trap, so x * 0 can be 0.
+static AST* new_op(NodeKind kind, AST* a, AST* b, int line){
+    switch(kind){
+        case PLUS_NODE:
+            if(is_int_const(a, 0)) return b;
+            if(is_int_const(b, 0)) return a;
+            break;
+
+        case MINUS_NODE:
+            if(is_int_const(b, 0)) return a;
+            break;
+
+        case TIMES_NODE:
+            if(is_int_const(a, 0) || is_int_const(b, 0)) return new_int(line, 0);
+            if(is_int_const(a, 1)) return b;
+            if(is_int_const(b, 1)) return a;
+            break;
+
+        default:
+            break;
+    }
+    return fold_node(new_ast_subtree(kind, NULL, line, INT_TYPE, 2, a, b));
+}
+
+static void cr_trim(CR* cr){
+    while(cr->degree > 0 && is_int_const(cr->coef[cr->degree], 0)) cr->degree--;
+}
+
+static void cr_combine(NodeKind kind, CR* a, CR* b, CR* out, int line){
+    out->degree = a->degree > b->degree ? a->degree : b->degree;
+    for(int j=0; j<=out->degree; j++){
+        AST* x = j <= a->degree ? a->coef[j] : new_int(line, 0);
+        AST* y = j <= b->degree ? b->coef[j] : new_int(line, 0);
+        out->coef[j] = new_op(kind, x, y, line);
+    }
+    cr_trim(out);
+}
+
+static void cr_scale(CR* a, AST* factor, CR* out, int line){
+    out->degree = a->degree;
+    for(int j=0; j<=a->degree; j++){
+        out->coef[j] = new_op(TIMES_NODE, a->coef[j], factor, line);
+    }
+    cr_trim(out);
+}
+
+// The same values one iteration later.
+static void cr_shift(CR* a, CR* out, int line){
+    out->degree = a->degree;
+    for(int j=0; j<a->degree; j++){
+        out->coef[j] = new_op(PLUS_NODE, a->coef[j], a->coef[j+1], line);
+    }
+    out->coef[a->degree] = a->coef[a->degree];
+}
+
+static int reads_var(AST* ast, int var){
+    if(get_ast_kind(ast) == VAR_USE_NODE) return (int) get_ast_data(ast) == var;
+    for(int i=0; i<get_ast_length(ast); i++){
+        if(reads_var(get_ast_child(ast, i), var)) return 1;
+    }
+    return 0;
+}
+
+static int reads_loop_var(AST* ast, Loop* loop){
+    if(get_ast_kind(ast) == VAR_USE_NODE) return loop->rec_of[(int) get_ast_data(ast)] >= 0;
+    for(int i=0; i<get_ast_length(ast); i++){
+        if(reads_loop_var(get_ast_child(ast, i), loop)) return 1;
+    }
+    return 0;
+}
+
+static int solve_rec(Loop* loop, Rec* rec);
+
+// Chain of expr as read by the update number pos (-1: before any update).
+static int cr_expr(Loop* loop, AST* expr, int pos, CR* out){
+    if(get_ast_type(expr) != INT_TYPE) return 0;
+
+    if(!reads_loop_var(expr, loop)){
+        if(may_trap(expr)) return 0;
+        out->coef[0] = expr;
+        out->degree = 0;
+        return 1;
+    }
+
+    CR a, b;
+    switch(get_ast_kind(expr)){
+        case VAR_USE_NODE: {
+            Rec* rec = &loop->recs[loop->rec_of[(int) get_ast_data(expr)]];
+            if(!solve_rec(loop, rec)) return 0;
+            if(rec->pos < pos) cr_shift(&rec->cr, out, loop->line);
+            else               *out = rec->cr;
+            return 1;
+        }
+
+        case PLUS_NODE:
+        case MINUS_NODE:
+            if(!cr_expr(loop, get_ast_child(expr, 0), pos, &a)) return 0;
+            if(!cr_expr(loop, get_ast_child(expr, 1), pos, &b)) return 0;
+            cr_combine(get_ast_kind(expr), &a, &b, out, loop->line);
+            return 1;
+
+        case TIMES_NODE:
+            if(!cr_expr(loop, get_ast_child(expr, 0), pos, &a)) return 0;
+            if(!cr_expr(loop, get_ast_child(expr, 1), pos, &b)) return 0;
+            if(a.degree == 0)      cr_scale(&b, a.coef[0], out, loop->line);
+            else if(b.degree == 0) cr_scale(&a, b.coef[0], out, loop->line);
+            else                   return 0;
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+static int solve_rec(Loop* loop, Rec* rec){
+    if(rec->state == 2) return 1;
+    if(rec->state == 1) return 0; // Depends on itself
+    rec->state = 1;
+
+    CR step;
+    if(!cr_expr(loop, rec->step, rec->pos, &step) || step.degree == CR_MAX_DEGREE) return 0;
+
+    rec->cr.coef[0] = rec->target;
+    for(int j=0; j<=step.degree; j++){
+        rec->cr.coef[j+1] = rec->negate ? new_op(MINUS_NODE, new_int(loop->line, 0), step.coef[j], loop->line)
+                                        : step.coef[j];
+    }
+    rec->cr.degree = step.degree + 1;
+    cr_trim(&rec->cr);
+
+    rec->state = 2;
+    return 1;
+}
+
+
+// Loops ----------------------------------------------------------------------
+
+// Matches v := v + e, v := e + v and v := v - e on an int v.
+static int get_update(AST* stmt, Rec* rec){
+    if(get_ast_kind(stmt) != ASSIGN_NODE) return 0;
+
+    AST* target = get_ast_child(stmt, 0);
+    AST* expr = get_ast_child(stmt, 1);
+    if(get_ast_type(target) != INT_TYPE) return 0;
+
+    NodeKind kind = get_ast_kind(expr);
+    if(kind != PLUS_NODE && kind != MINUS_NODE) return 0;
+
+    AST* l = get_ast_child(expr, 0);
+    AST* r = get_ast_child(expr, 1);
+    int var = get_ast_data(target);
+    int l_is_var = get_ast_kind(l) == VAR_USE_NODE && (int) get_ast_data(l) == var;
+    int r_is_var = get_ast_kind(r) == VAR_USE_NODE && (int) get_ast_data(r) == var;
+
+    rec->target = target;
+    rec->negate = kind == MINUS_NODE;
+    if(l_is_var)                       rec->step = r;
+    else if(r_is_var && !rec->negate)  rec->step = l;
+    else                               return 0;
+    return 1;
+}
+
+// Value of rec after k iterations.
+static AST* closed_form(Rec* rec, AST* k_var, int line){
+    AST* value = rec->cr.coef[0];
+    for(int j=1; j<=rec->cr.degree; j++){
+        AST* choose = new_var_use(k_var, line); // C(k,1)
+        if(j > 1){
+            choose = new_ast_subtree(CHOOSE_NODE, NULL, line, INT_TYPE, 1, choose);
+            set_ast_data(choose, j);
+        }
+        value = new_op(PLUS_NODE, value, new_op(TIMES_NODE, rec->cr.coef[j], choose, line), line);
+    }
+    return copy_ast(value);
+}
+
+// Returns the statements replacing repeat, or NULL to keep it.
+static AST* solve_loop(AST* repeat){
+    AST* body = get_ast_child(repeat, 1);
+    AST* cond = get_ast_child(repeat, 0);
+    int count = get_ast_length(body);
+    if(count == 0 || get_ast_kind(cond) != LT_NODE) return NULL;
+
+    Loop loop;
+    loop.line = get_ast_line(cond);
+    loop.recs = calloc(count, sizeof(Rec));
+    CHECK_PTR_MSG(loop.recs, "Could not allocate memory");
+    for(int var=0; var<MEM_SIZE; var++) loop.rec_of[var] = -1;
+
+    AST* result = NULL;
+    int line = loop.line;
+
+    for(int s=0; s<count; s++){
+        Rec* rec = &loop.recs[s];
+        if(!get_update(get_ast_child(body, s), rec)) goto done;
+
+        int var = get_ast_data(rec->target);
+        if(loop.rec_of[var] >= 0) goto done; // Updated twice
+        loop.rec_of[var] = s;
+        rec->pos = s;
+    }
+    for(int s=0; s<count; s++){
+        if(!solve_rec(&loop, &loop.recs[s])) goto done;
+    }
+
+    // The condition sees every update of the iteration: after k of them.
+    CR l, r;
+    AST *start, *bound;
+    int step;
+    if(!cr_expr(&loop, get_ast_child(cond, 0), -1, &l)) goto done;
+    if(!cr_expr(&loop, get_ast_child(cond, 1), -1, &r)) goto done;
+
+    if(l.degree == 0 && r.degree == 1 && get_ast_kind(r.coef[1]) == INT_VAL_NODE && get_ast_data(r.coef[1]) > 0){
+        start = r.coef[0]; // Until bound < start + k*step
+        bound = l.coef[0];
+        step = get_ast_data(r.coef[1]);
+    }
+    else if(r.degree == 0 && l.degree == 1 && get_ast_kind(l.coef[1]) == INT_VAL_NODE && get_ast_data(l.coef[1]) < 0){
+        start = l.coef[0]; // Until start + k*step < bound
+        bound = r.coef[0];
+        step = get_ast_data(l.coef[1]);
+    }
+    else goto done;
+
+    // A value read by a later closed form waits in a temporary.
+    char* wait = calloc(count, sizeof(char));
+    CHECK_PTR_MSG(wait, "Could not allocate memory");
+    int temps = 1; // $k
+    for(int s=0; s<count; s++){
+        int var = get_ast_data(loop.recs[s].target);
+        for(int t=s+1; t<count && !wait[s]; t++){
+            for(int j=0; j<=loop.recs[t].cr.degree; j++){
+                if(reads_var(loop.recs[t].cr.coef[j], var)) wait[s] = 1;
+            }
+        }
+        temps += wait[s];
+    }
+    if(get_var_table_length(vt) + temps > MEM_SIZE){
+        free(wait);
+        goto done;
+    }
+
+    AST* k_var = new_temp_var(INT_TYPE);
+    AST* closed = new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 0);
+    AST* copies = new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 0);
+    for(int s=0; s<count; s++){
+        Rec* rec = &loop.recs[s];
+        AST* value = closed_form(rec, k_var, line);
+        if(wait[s]){
+            AST* temp = new_temp_var(INT_TYPE);
+            add_ast_child(closed, new_assign(temp, value));
+            value = new_var_use(temp, line);
+        }
+        AST* assign = new_ast_subtree(ASSIGN_NODE, NULL, line, NO_TYPE, 2, copy_ast(rec->target), value);
+        add_ast_child(wait[s] ? copies : closed, assign);
+    }
+    for(int i=0; i<get_ast_length(copies); i++){
+        add_ast_child(closed, get_ast_child(copies, i));
+    }
+    free(wait);
+
+    AST* trip = new_ast_subtree(TRIP_COUNT_NODE, NULL, line, INT_TYPE, 2, copy_ast(start), copy_ast(bound));
+    set_ast_data(trip, step);
+    AST* no_trip = new_ast_subtree(EQ_NODE, NULL, line, BOOL_TYPE, 2, new_var_use(k_var, line), new_int(line, 0));
+    result = new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 2,
+                 new_assign(k_var, trip),
+                 new_ast_subtree(IF_NODE, NULL, line, NO_TYPE, 3, no_trip,
+                                 new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 1, repeat),
+                                 closed));
+
+done:
+    free(loop.recs);
+    return result;
+}
+
+static AST* solve_stmt_list(AST* list){
+    if(!list) return NULL;
+
+    AST* new_list = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(list), NO_TYPE, 0);
+
+    for(int s=0; s<get_ast_length(list); s++){
+        AST* stmt = get_ast_child(list, s);
+        NodeKind kind = get_ast_kind(stmt);
+
+        if(kind == IF_NODE || kind == REPEAT_NODE){
+            for(int i=1; i<get_ast_length(stmt); i++){
+                set_ast_child(stmt, i, solve_stmt_list(get_ast_child(stmt, i)));
+            }
+        }
+
+        AST* solved = kind == REPEAT_NODE ? solve_loop(stmt) : NULL;
+        if(!solved){
+            add_ast_child(new_list, stmt);
+            continue;
+        }
+        for(int i=0; i<get_ast_length(solved); i++){
+            add_ast_child(new_list, get_ast_child(solved, i));
+        }
+    }
+
+    return new_list;
+}
+
+AST* solve_recurrences(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    set_ast_child(ast, 1, solve_stmt_list(get_ast_child(ast, 1)));
+    return ast;
+}
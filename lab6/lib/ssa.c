@@ -0,0 +1,625 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "optimizer.h"
+#include "ssa.h"
+
+// SSA form
+// ----------------------------------------------------------------------------
+// Construction follows Braun et al., "Simple and Efficient Construction of
+// Static Single Assignment Form": each block maps every variable to its
+// current version, a read in a block without one asks the predecessors and
+// puts a phi where they join. A loop's first block only knows all its
+// predecessors once the body is built, so it stays unsealed until then and
+// the phis created meanwhile get their arguments when it is sealed. Phis
+// that merge a single value are replaced by it at the end.
+//
+//   if c then A else B end    [test: branch c] -> [A] -> [join]
+//                                             \-> [B] -/
+//   repeat A until c          [..] -> [A ... test: branch c] -> [exit]
+//                                      ^-------------------/ (c false)
+// An if always gets an else block, even empty, so no edge goes from a block
+// with two successors to one with two predecessors but the loop back edge.
+//
+// ssa_to_ast walks the same shapes back into if and repeat statements.
+
+extern VarTable *vt;
+
+
+// Construction ---------------------------------------------------------------
+
+// Grows array, of length elements of the given size, in SSA_BLOCK_SIZE steps.
+static void* grow(void* array, int length, size_t size){
+    if(length%SSA_BLOCK_SIZE == 0){
+        array = realloc(array, (length+SSA_BLOCK_SIZE)*size);
+        CHECK_PTR_MSG(array, "Could not reallocate memory");
+    }
+    return array;
+}
+
+static Value* new_value(SSA* ssa, ValueKind kind, NodeKind op, Type type, double data, int line){
+    Value* value = calloc(1, sizeof(Value));
+    CHECK_PTR_MSG(value, "Could not allocate memory");
+    value->id = ssa->value_count;
+    value->kind = kind;
+    value->op = op;
+    value->type = type;
+    value->data = data;
+    value->var = -1;
+    value->line = line;
+
+    ssa->values = grow(ssa->values, ssa->value_count, sizeof(Value*));
+    ssa->values[ssa->value_count++] = value;
+    return value;
+}
+
+static void add_arg(Value* value, Value* arg){
+    value->args = grow(value->args, value->arg_count, sizeof(Value*));
+    value->args[value->arg_count++] = arg;
+}
+
+static Block* new_block(SSA* ssa){
+    Block* block = calloc(1, sizeof(Block));
+    CHECK_PTR_MSG(block, "Could not allocate memory");
+    block->id = ssa->block_count;
+    block->end = RETURN_END;
+    block->defs = calloc(ssa->var_count + 1, sizeof(Value*));
+    CHECK_PTR_MSG(block->defs, "Could not allocate memory");
+
+    ssa->blocks = grow(ssa->blocks, ssa->block_count, sizeof(Block*));
+    ssa->blocks[ssa->block_count++] = block;
+    return block;
+}
+
+static void add_pred(Block* block, Block* pred){
+    block->preds = grow(block->preds, block->pred_count, sizeof(Block*));
+    block->preds[block->pred_count++] = pred;
+}
+
+static void append_inst(Block* block, Value* value){
+    value->block = block;
+    block->insts = grow(block->insts, block->inst_count, sizeof(Value*));
+    block->insts[block->inst_count++] = value;
+}
+
+static void jump(Block* from, Block* to){
+    from->end = JUMP_END;
+    from->succ[0] = to;
+    add_pred(to, from);
+}
+
+static void branch(Block* from, Value* cond, Block* if_true, Block* if_false){
+    from->end = BRANCH_END;
+    from->cond = cond;
+    from->succ[0] = if_true;
+    from->succ[1] = if_false;
+    add_pred(if_true, from);
+    add_pred(if_false, from);
+}
+
+static Value* entry_value(SSA* ssa, int var){
+    if(!ssa->entries[var]){
+        AST* decl = get_table_var(vt, var);
+        Value* value = new_value(ssa, ENTRY_VALUE, NONE, get_ast_type(decl), 0, get_ast_line(decl));
+        value->var = var;
+        ssa->entries[var] = value;
+    }
+    return ssa->entries[var];
+}
+
+static Value* new_phi(SSA* ssa, Block* block, int var){
+    Value* phi = new_value(ssa, PHI_VALUE, NONE, get_ast_type(get_table_var(vt, var)), 0, 0);
+    phi->var = var;
+    phi->block = block;
+    block->phis = grow(block->phis, block->phi_count, sizeof(Value*));
+    block->phis[block->phi_count++] = phi;
+    return phi;
+}
+
+static Value* read_var(SSA* ssa, Block* block, int var);
+
+static void add_phi_args(SSA* ssa, Value* phi){
+    for(int i=0; i<phi->block->pred_count; i++){
+        add_arg(phi, read_var(ssa, phi->block->preds[i], phi->var));
+    }
+}
+
+static Value* read_var(SSA* ssa, Block* block, int var){
+    if(block->defs[var]) return get_ssa_value(block->defs[var]);
+
+    Value* value;
+    if(!block->sealed){
+        value = new_phi(ssa, block, var); // Arguments come with seal()
+    }
+    else if(block->pred_count == 0){
+        value = entry_value(ssa, var);
+    }
+    else if(block->pred_count == 1){
+        value = read_var(ssa, block->preds[0], var);
+    }
+    else{
+        // Recorded before asking the predecessors, a loop leads back here.
+        value = new_phi(ssa, block, var);
+        block->defs[var] = value;
+        add_phi_args(ssa, value);
+    }
+
+    block->defs[var] = value;
+    return value;
+}
+
+static void seal(SSA* ssa, Block* block){
+    for(int i=0; i<block->phi_count; i++){
+        add_phi_args(ssa, block->phis[i]);
+    }
+    block->sealed = 1;
+}
+
+static Value* lower_expr(SSA* ssa, Block* block, AST* expr){
+    NodeKind kind = get_ast_kind(expr);
+    int line = get_ast_line(expr);
+
+    switch(kind){
+        case VAR_USE_NODE:
+            return read_var(ssa, block, get_ast_data(expr));
+
+        case BOOL_VAL_NODE:
+        case INT_VAL_NODE:
+        case REAL_VAL_NODE:
+        case STR_VAL_NODE:
+            return new_value(ssa, CONST_VALUE, kind, get_ast_type(expr), get_ast_data(expr), line);
+
+        default: {
+            Value* value = new_value(ssa, OP_VALUE, kind, get_ast_type(expr), get_ast_data(expr), line);
+            for(int i=0; i<get_ast_length(expr); i++){
+                add_arg(value, lower_expr(ssa, block, get_ast_child(expr, i)));
+            }
+            append_inst(block, value);
+            return value;
+        }
+    }
+}
+
+// Adds stmt to block, returns the block where the code after it goes.
+static Block* lower_stmt(SSA* ssa, Block* block, AST* stmt){
+    int line = get_ast_line(stmt);
+
+    switch(get_ast_kind(stmt)){
+
+        case STMT_LIST_NODE:
+            for(int i=0; i<get_ast_length(stmt); i++){
+                block = lower_stmt(ssa, block, get_ast_child(stmt, i));
+            }
+            return block;
+
+        case ASSIGN_NODE: {
+            AST* target = get_ast_child(stmt, 0);
+            int var = get_ast_data(target);
+            Value* value = lower_expr(ssa, block, get_ast_child(stmt, 1));
+
+            // The operation computed for this statement becomes the version,
+            // anything else (variable, constant) is copied.
+            if(value->kind != OP_VALUE || value->var >= 0){
+                Value* copy = new_value(ssa, COPY_VALUE, NONE, get_ast_type(target), 0, line);
+                add_arg(copy, value);
+                append_inst(block, copy);
+                value = copy;
+            }
+            value->var = var;
+            value->line = line;
+            block->defs[var] = value;
+            return block;
+        }
+
+        case READ_NODE: {
+            AST* target = get_ast_child(stmt, 0);
+            Value* value = new_value(ssa, READ_VALUE, NONE, get_ast_type(target), 0, line);
+            value->var = get_ast_data(target);
+            append_inst(block, value);
+            block->defs[value->var] = value;
+            return block;
+        }
+
+        case WRITE_NODE: {
+            Value* value = new_value(ssa, WRITE_VALUE, NONE, NO_TYPE, 0, line);
+            add_arg(value, lower_expr(ssa, block, get_ast_child(stmt, 0)));
+            append_inst(block, value);
+            return block;
+        }
+
+        case IF_NODE: {
+            Value* cond = lower_expr(ssa, block, get_ast_child(stmt, 0));
+            Block* then_block = new_block(ssa);
+            Block* else_block = new_block(ssa);
+            Block* join = new_block(ssa);
+            branch(block, cond, then_block, else_block);
+            block->join = join;
+            seal(ssa, then_block);
+            seal(ssa, else_block);
+
+            jump(lower_stmt(ssa, then_block, get_ast_child(stmt, 1)), join);
+            if(get_ast_child(stmt, 2)) else_block = lower_stmt(ssa, else_block, get_ast_child(stmt, 2));
+            jump(else_block, join);
+            seal(ssa, join);
+            return join;
+        }
+
+        case REPEAT_NODE: {
+            Block* header = new_block(ssa);
+            jump(block, header);
+
+            Block* latch = lower_stmt(ssa, header, get_ast_child(stmt, 1));
+            Value* cond = lower_expr(ssa, latch, get_ast_child(stmt, 0));
+            Block* exit = new_block(ssa);
+            branch(latch, cond, exit, header);
+            header->latch = latch;
+            latch->header = header;
+            seal(ssa, header);
+            seal(ssa, exit);
+            return exit;
+        }
+
+        default:
+            SWITCH_ERROR(get_ast_kind(stmt));
+    }
+}
+
+// Replaces phis merging one value (besides themselves) until none is left.
+static void remove_trivial_phis(SSA* ssa){
+    int changed;
+    do{
+        changed = 0;
+        for(int b=0; b<ssa->block_count; b++){
+            Block* block = ssa->blocks[b];
+            for(int i=0; i<block->phi_count; i++){
+                Value* phi = block->phis[i];
+                if(phi->repl) continue;
+
+                Value* same = NULL;
+                int trivial = 1;
+                for(int j=0; j<phi->arg_count && trivial; j++){
+                    Value* arg = get_ssa_value(phi->args[j]);
+                    if(arg == same || arg == phi) continue;
+                    if(same) trivial = 0;
+                    same = arg;
+                }
+                if(trivial){
+                    phi->repl = same ? same : entry_value(ssa, phi->var);
+                    changed = 1;
+                }
+            }
+        }
+    } while(changed);
+
+    // Point everything at the survivors.
+    for(int v=0; v<ssa->value_count; v++){
+        Value* value = ssa->values[v];
+        for(int j=0; j<value->arg_count; j++){
+            value->args[j] = get_ssa_value(value->args[j]);
+        }
+    }
+    for(int b=0; b<ssa->block_count; b++){
+        Block* block = ssa->blocks[b];
+        if(block->cond) block->cond = get_ssa_value(block->cond);
+
+        int count = 0;
+        for(int i=0; i<block->phi_count; i++){
+            if(!block->phis[i]->repl) block->phis[count++] = block->phis[i];
+        }
+        block->phi_count = count;
+    }
+}
+
+SSA* build_ssa(AST* program){
+    CHECK_PTR(program);
+
+    SSA* ssa = calloc(1, sizeof(SSA));
+    CHECK_PTR_MSG(ssa, "Could not allocate memory");
+    ssa->program = program;
+    ssa->var_count = get_var_table_length(vt);
+    ssa->entries = calloc(ssa->var_count + 1, sizeof(Value*));
+    CHECK_PTR_MSG(ssa->entries, "Could not allocate memory");
+
+    Block* entry = new_block(ssa);
+    entry->sealed = 1;
+    Block* last = lower_stmt(ssa, entry, get_ast_child(program, 1));
+    last->end = RETURN_END;
+
+    remove_trivial_phis(ssa);
+    return ssa;
+}
+
+void free_ssa(SSA* ssa){
+    if(!ssa) return;
+    for(int v=0; v<ssa->value_count; v++){
+        free(ssa->values[v]->args);
+        free(ssa->values[v]);
+    }
+    for(int b=0; b<ssa->block_count; b++){
+        Block* block = ssa->blocks[b];
+        free(block->phis);
+        free(block->insts);
+        free(block->preds);
+        free(block->defs);
+        free(block);
+    }
+    free(ssa->values);
+    free(ssa->blocks);
+    free(ssa->entries);
+    free(ssa);
+}
+
+
+// Get
+Value* get_ssa_value(Value* value){
+    while(value && value->repl) value = value->repl;
+    return value;
+}
+
+
+// Output
+static void print_ref(Value* value, FILE* file){
+    if(value->kind != CONST_VALUE){
+        fprintf(file, "v%d", value->id);
+        return;
+    }
+    switch(value->op){
+        case BOOL_VAL_NODE: fprintf(file, "%s", value->data ? "true" : "false"); break;
+        case INT_VAL_NODE:  fprintf(file, "%d", (int) value->data); break;
+        case REAL_VAL_NODE: fprintf(file, "%f", value->data); break;
+        case STR_VAL_NODE:  fprintf(file, "@%d", (int) value->data); break;
+        default:            SWITCH_ERROR(value->op);
+    }
+}
+
+static void print_value(Value* value, FILE* file){
+    fprintf(file, "    ");
+    if(value->kind != WRITE_VALUE) fprintf(file, "v%d = ", value->id);
+
+    switch(value->kind){
+        case PHI_VALUE:   fprintf(file, "phi"); break;
+        case OP_VALUE:    fprintf(file, "%s", get_kind_str(value->op)); break;
+        case COPY_VALUE:  fprintf(file, "copy"); break;
+        case READ_VALUE:  fprintf(file, "read"); break;
+        case WRITE_VALUE: fprintf(file, "write"); break;
+        default:          SWITCH_ERROR(value->kind);
+    }
+    if(value->kind == OP_VALUE && value->data) fprintf(file, " [%g]", value->data);
+
+    for(int i=0; i<value->arg_count; i++){
+        fprintf(file, i ? ", " : " ");
+        print_ref(value->args[i], file);
+    }
+    if(value->kind != WRITE_VALUE) fprintf(file, " : %s", get_type_str(value->type));
+    if(value->var >= 0) fprintf(file, " -> %s", get_ast_name(get_table_var(vt, value->var)));
+    fprintf(file, "\n");
+}
+
+// One block after the other:
+//   b2: <- b1 b5
+//       v7 = phi v3, v12 : int -> i
+//       v8 = + v7, 1 : int -> i
+//       branch v9 ? b6 : b2
+void print_ssa(SSA* ssa, FILE* file){
+    CHECK_PTR(ssa);
+
+    for(int var=0; var<ssa->var_count; var++){
+        Value* entry = ssa->entries[var];
+        if(entry) fprintf(file, "v%d = entry %s : %s\n", entry->id, get_ast_name(get_table_var(vt, var)), get_type_str(entry->type));
+    }
+
+    for(int b=0; b<ssa->block_count; b++){
+        Block* block = ssa->blocks[b];
+        fprintf(file, "\nb%d:", block->id);
+        if(block->pred_count) fprintf(file, " <-");
+        for(int i=0; i<block->pred_count; i++) fprintf(file, " b%d", block->preds[i]->id);
+        fprintf(file, "\n");
+
+        for(int i=0; i<block->phi_count; i++) print_value(block->phis[i], file);
+        for(int i=0; i<block->inst_count; i++) print_value(block->insts[i], file);
+
+        switch(block->end){
+            case JUMP_END:
+                fprintf(file, "    jump b%d\n", block->succ[0]->id);
+                break;
+            case BRANCH_END:
+                fprintf(file, "    branch ");
+                print_ref(block->cond, file);
+                fprintf(file, " ? b%d : b%d\n", block->succ[0]->id, block->succ[1]->id);
+                break;
+            case RETURN_END:
+                fprintf(file, "    return\n");
+                break;
+        }
+    }
+}
+
+
+// Back to the AST ------------------------------------------------------------
+// A value with a variable is stored in it where it is defined and read from
+// it everywhere else. An operation with no variable, used once further down
+// its own block before any variable changes, is rebuilt inside its user as
+// it was in the source; otherwise it gets a temporary.
+
+typedef struct {
+    int uses;
+    Block* user;  // Block of the last use
+    int user_pos; // Its position there, inst_count for the block's end
+    int pos;      // Position in its own block
+    AST* temp;    // Temporary declaration, if it needs one
+} UseInfo;
+
+static UseInfo* info;
+
+static void count_use(Value* value, Block* user, int pos){
+    UseInfo* u = &info[value->id];
+    u->uses++;
+    u->user = user;
+    u->user_pos = pos;
+}
+
+static void count_uses(SSA* ssa){
+    for(int b=0; b<ssa->block_count; b++){
+        Block* block = ssa->blocks[b];
+        for(int i=0; i<block->inst_count; i++){
+            Value* value = block->insts[i];
+            info[value->id].pos = i;
+            for(int j=0; j<value->arg_count; j++) count_use(value->args[j], block, i);
+        }
+        if(block->cond) count_use(block->cond, block, block->inst_count);
+
+        // Phi arguments are read at the end of the predecessor.
+        for(int i=0; i<block->phi_count; i++){
+            Value* phi = block->phis[i];
+            for(int j=0; j<phi->arg_count; j++) count_use(phi->args[j], block->preds[j], block->preds[j]->inst_count + 1);
+        }
+    }
+}
+
+static int is_inlined(Value* value){
+    if(value->kind != OP_VALUE || value->var >= 0) return 0;
+
+    UseInfo* u = &info[value->id];
+    if(u->uses != 1 || u->user != value->block) return 0;
+    for(int i=u->pos+1; i<u->user_pos && i<value->block->inst_count; i++){
+        Value* between = value->block->insts[i];
+        if(between->var >= 0) return 0;
+    }
+    return 1;
+}
+
+static AST* emit_op(Value* value);
+
+static AST* emit_use(Value* value, int line){
+    if(value->kind == CONST_VALUE) return new_ast(value->op, NULL, line, value->type, value->data);
+    if(value->var >= 0)            return new_var_use(get_table_var(vt, value->var), line);
+    if(info[value->id].temp)       return new_var_use(info[value->id].temp, line);
+    return emit_op(value);
+}
+
+static AST* emit_op(Value* value){
+    AST* ast = new_ast(value->op, NULL, value->line, value->type, value->data);
+    for(int i=0; i<value->arg_count; i++){
+        add_ast_child(ast, emit_use(value->args[i], value->line));
+    }
+    return ast;
+}
+
+static AST* new_store(int var, AST* expr, int line){
+    AST* target = new_var_use(get_table_var(vt, var), line);
+    return new_ast_subtree(ASSIGN_NODE, NULL, line, NO_TYPE, 2, target, expr);
+}
+
+// Copies for the phis of succ whose argument from block lives elsewhere.
+static void emit_phi_copies(Block* block, Block* succ, AST* list){
+    int j = 0;
+    while(succ->preds[j] != block) j++;
+
+    for(int i=0; i<succ->phi_count; i++){
+        Value* phi = succ->phis[i];
+        Value* arg = phi->args[j];
+        if(arg->var != phi->var) add_ast_child(list, new_store(phi->var, emit_use(arg, arg->line), arg->line));
+    }
+}
+
+// Returns the condition the block ends with, if any.
+static AST* emit_block(Block* block, AST* list){
+    for(int i=0; i<block->inst_count; i++){
+        Value* value = block->insts[i];
+        int line = value->line;
+
+        switch(value->kind){
+            case OP_VALUE:
+                if(value->var >= 0){
+                    add_ast_child(list, new_store(value->var, emit_op(value), line));
+                }
+                else if(info[value->id].uses > 0 && !is_inlined(value)){
+                    AST* temp = new_temp_var(value->type);
+                    CHECK_PTR_MSG(temp, "No variable slot left for a temporary");
+                    info[value->id].temp = temp;
+                    add_ast_child(list, new_assign(temp, emit_op(value)));
+                }
+                break;
+
+            case COPY_VALUE:
+                add_ast_child(list, new_store(value->var, emit_use(value->args[0], line), line));
+                break;
+
+            case READ_VALUE:
+                add_ast_child(list, new_ast_subtree(READ_NODE, NULL, line, NO_TYPE, 1,
+                                                    new_var_use(get_table_var(vt, value->var), line)));
+                break;
+
+            case WRITE_VALUE:
+                add_ast_child(list, new_ast_subtree(WRITE_NODE, NULL, line, NO_TYPE, 1, emit_use(value->args[0], line)));
+                break;
+
+            default:
+                SWITCH_ERROR(value->kind);
+        }
+    }
+
+    if(block->end == JUMP_END) emit_phi_copies(block, block->succ[0], list);
+    if(block->header)          emit_phi_copies(block, block->header, list);
+
+    return block->end == BRANCH_END ? emit_use(block->cond, block->cond->line) : NULL;
+}
+
+// Emits the blocks from block up to stop (excluded) into list. Returns the
+// until condition when it ends at the latch of the loop being emitted.
+static AST* emit_region(Block* block, Block* stop, AST* list){
+    while(block != stop){
+        if(block->latch && !block->looping){
+            AST* body = new_ast_subtree(STMT_LIST_NODE, NULL, 0, NO_TYPE, 0);
+            block->looping = 1;
+            AST* cond = emit_region(block, NULL, body);
+            block->looping = 0;
+
+            add_ast_child(list, new_ast_subtree(REPEAT_NODE, NULL, get_ast_line(cond), NO_TYPE, 2, cond, body));
+            block = block->latch->succ[0];
+            continue;
+        }
+
+        AST* cond = emit_block(block, list);
+        if(block->header) return cond;
+
+        switch(block->end){
+            case JUMP_END:
+                block = block->succ[0];
+                break;
+
+            case BRANCH_END: {
+                AST* then_list = new_ast_subtree(STMT_LIST_NODE, NULL, 0, NO_TYPE, 0);
+                AST* else_list = new_ast_subtree(STMT_LIST_NODE, NULL, 0, NO_TYPE, 0);
+                emit_region(block->succ[0], block->join, then_list);
+                emit_region(block->succ[1], block->join, else_list);
+
+                AST* if_stmt = new_ast_subtree(IF_NODE, NULL, get_ast_line(cond), NO_TYPE, 2, cond, then_list);
+                if(get_ast_length(else_list) > 0) add_ast_child(if_stmt, else_list);
+                add_ast_child(list, if_stmt);
+                block = block->join;
+                break;
+            }
+
+            case RETURN_END:
+                return NULL;
+        }
+    }
+    return NULL;
+}
+
+AST* ssa_to_ast(SSA* ssa){
+    CHECK_PTR(ssa);
+
+    info = calloc(ssa->value_count, sizeof(UseInfo));
+    CHECK_PTR_MSG(info, "Could not allocate memory");
+    count_uses(ssa);
+
+    AST* stmts = new_ast_subtree(STMT_LIST_NODE, NULL, 0, NO_TYPE, 0);
+    emit_region(ssa->blocks[0], NULL, stmts);
+
+    free(info);
+    info = NULL;
+    return new_ast_subtree(PROGRAM_NODE, NULL, 0, NO_TYPE, 2, get_ast_child(ssa->program, 0), stmts);
+}
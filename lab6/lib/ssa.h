@@ -0,0 +1,93 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include <stdio.h>
+#include "debug.h"
+#include "ast.h"
+
+// SSA form ------------------------------------------
+// Control-flow graph of a program, every variable version a Value defined
+// once. Built from the typed AST by build_ssa, turned back into an AST the
+// interpreter can run by ssa_to_ast.
+//
+// Each version keeps the variable it was assigned to (var), and ssa_to_ast
+// stores it in that variable's slot. Passes must not make two versions of
+// the same variable live at the same time; values with no variable get a
+// temporary when they are not used right where they are computed.
+#define SSA_BLOCK_SIZE 16
+
+typedef enum {
+    CONST_VALUE, // Literal, op is the AST kind (INT_VAL_NODE, ...)
+    ENTRY_VALUE, // Variable as the program starts (cleared memory)
+    PHI_VALUE,
+    OP_VALUE,    // Operation or conversion, op is the AST kind
+    COPY_VALUE,  // x := y, x := constant
+    READ_VALUE,
+    WRITE_VALUE  // No value, it only uses one
+} ValueKind;
+
+typedef enum {
+    JUMP_END,
+    BRANCH_END, // succ[0] if cond is true, succ[1] otherwise
+    RETURN_END
+} EndKind;
+
+typedef struct value Value;
+typedef struct block Block;
+
+struct value {
+    int id;
+    ValueKind kind;
+    NodeKind op;
+    Type type;
+    double data;    // As in the AST node
+    int var;        // Variable holding the value, -1 if none
+    int line;
+    Value** args;   // A phi has one per predecessor, in the same order
+    int arg_count;
+    Block* block;   // NULL for constants and entry values
+    Value* repl;    // Replacement of a phi found trivial, NULL otherwise
+};
+
+struct block {
+    int id;
+    Value** phis;
+    int phi_count;
+    Value** insts;  // In execution order
+    int inst_count;
+    Block** preds;
+    int pred_count;
+    EndKind end;
+    Value* cond;    // BRANCH_END
+    Block* succ[2];
+    Block* join;    // Block testing an if: where both branches meet
+    Block* latch;   // First block of a loop body: the block testing until
+    Block* header;  // Block testing until: the first block of the body
+    int sealed;     // All predecessors known (construction)
+    Value** defs;   // Current version of each variable (construction)
+    int looping;    // Loop being emitted (ssa_to_ast)
+};
+
+typedef struct {
+    AST* program;
+    Block** blocks;
+    int block_count;
+    Value** values;
+    int value_count;
+    Value** entries; // ENTRY_VALUE by variable, created on first use
+    int var_count;
+} SSA;
+
+// Create
+SSA* build_ssa(AST* program);
+void free_ssa(SSA* ssa);
+
+// Get
+Value* get_ssa_value(Value* value); // Follows phi replacements
+
+// Output
+void print_ssa(SSA* ssa, FILE* file);
+AST* ssa_to_ast(SSA* ssa);
+//----------------------------------------------------
+
+#endif // SSA_H
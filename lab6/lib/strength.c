@@ -0,0 +1,282 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "optimizer.h"
+
+// Strength reduction
+// ----------------------------------------------------------------------------
+// Runs after the loop and value passes, it brings in node kinds they do not
+// know about. Only analyze_ranges and share_slots come after it, and both
+// handle those kinds.
+//
+// Induction variables: a variable whose only write in a repeat is
+// v := v + c (or v - c) straight in the body goes up by c each iteration, so
+// v * k goes up by c * k. When such a product is read IV_MIN_USES times or
+// more in the loop, it is kept in a temporary set before the loop and bumped
+// right after v is; a product read once is cheaper to compute than to keep.
+// Both sides wrap the same way, int arithmetic being modulo 2^32.
+//
+// Constant operands, on int values:
+//   - x * 1 and x / 1 are x, x * 0 is 0 when x cannot trap;
+//   - x * 2^k becomes SHL_NODE;
+//   - x / d becomes DIV_CONST_NODE, which multiplies by a magic number
+//     and shifts (Hacker's Delight, chapter 10), truncating toward zero
+//     like C. d = -1 and INT_MIN are left alone.
+// Other multiplications stay: each node costs a dispatch, more than the
+// multiply a shift-and-add sequence would save.
+
+#define IV_MIN_USES 2
+#define PRODUCT_BLOCK_SIZE 16
+
+typedef struct {
+    AST* parent; // The product is parent's child number 'child'
+    int child;
+    int factor;
+} Product;
+
+typedef struct {
+    int var;
+    int step;
+    Product* products;
+    int count;
+} Induction;
+
+
+// Induction variables --------------------------------------------------------
+
+// Factor of expr if it is var * k, k a constant.
+static int get_factor(AST* expr, int var, int* factor){
+    if(get_ast_kind(expr) != TIMES_NODE || get_ast_type(expr) != INT_TYPE) return 0;
+
+    AST* l = get_ast_child(expr, 0);
+    AST* r = get_ast_child(expr, 1);
+    if(get_ast_kind(l) == INT_VAL_NODE){
+        AST* t = l; l = r; r = t;
+    }
+    if(get_ast_kind(l) != VAR_USE_NODE || (int) get_ast_data(l) != var) return 0;
+    if(get_ast_kind(r) != INT_VAL_NODE) return 0;
+
+    *factor = get_ast_data(r);
+    return 1;
+}
+
+static void find_products(AST* parent, Induction* iv){
+    for(int i=0; i<get_ast_length(parent); i++){
+        AST* child = get_ast_child(parent, i);
+        int factor;
+
+        if(get_factor(child, iv->var, &factor)){
+            if(iv->count%PRODUCT_BLOCK_SIZE == 0){
+                iv->products = realloc(iv->products, (iv->count+PRODUCT_BLOCK_SIZE)*sizeof(Product));
+                CHECK_PTR_MSG(iv->products, "Could not reallocate memory");
+            }
+            Product p = {parent, i, factor};
+            iv->products[iv->count++] = p;
+        }
+        else{
+            find_products(child, iv);
+        }
+    }
+}
+
+// Moves the products of iv out of the loop. The updates of the temporaries
+// go to 'after', the prelude to 'prelude'.
+static void reduce_iv(Induction* iv, AST* after, AST* prelude){
+    for(int first=0; first<iv->count; first++){
+        int factor = iv->products[first].factor;
+        if(!iv->products[first].parent) continue; // Already moved
+
+        int uses = 0;
+        for(int i=first; i<iv->count; i++){
+            if(iv->products[i].parent && iv->products[i].factor == factor) uses++;
+        }
+        if(uses < IV_MIN_USES) continue;
+
+        AST* temp = new_temp_var(INT_TYPE);
+        if(!temp) return;
+
+        AST* product = get_ast_child(iv->products[first].parent, iv->products[first].child);
+        int line = get_ast_line(product);
+        add_ast_child(prelude, new_assign(temp, copy_ast(product)));
+
+        int inc = (unsigned) iv->step * (unsigned) factor;
+        AST* bump = new_ast_subtree(PLUS_NODE, NULL, line, INT_TYPE, 2,
+                                    new_var_use(temp, line), new_ast(INT_VAL_NODE, NULL, line, INT_TYPE, inc));
+        add_ast_child(after, new_assign(temp, bump));
+
+        for(int i=first; i<iv->count; i++){
+            Product* p = &iv->products[i];
+            if(!p->parent || p->factor != factor) continue;
+            set_ast_child(p->parent, p->child, new_var_use(temp, get_ast_line(get_ast_child(p->parent, p->child))));
+            p->parent = NULL;
+        }
+    }
+}
+
+// Returns the statements to run before the loop (possibly none).
+static AST* reduce_loop(AST* repeat){
+    AST* prelude = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(repeat), NO_TYPE, 0);
+    AST* body = get_ast_child(repeat, 1);
+    int length = get_ast_length(body);
+
+    int writes[MEM_SIZE] = {0};
+    count_writes(repeat, writes);
+
+    AST** after = calloc(length, sizeof(AST*)); // Updates to run after each stmt
+    CHECK_PTR_MSG(after, "Could not allocate memory");
+    int changed = 0;
+
+    for(int s=0; s<length; s++){
+        Induction iv = {0, 0, NULL, 0};
+        if(!get_counter_step(get_ast_child(body, s), &iv.var, &iv.step) || writes[iv.var] != 1) continue;
+
+        find_products(repeat, &iv);
+        after[s] = new_ast_subtree(STMT_LIST_NODE, NULL, 0, NO_TYPE, 0);
+        reduce_iv(&iv, after[s], prelude);
+        if(get_ast_length(after[s]) > 0) changed = 1;
+        free(iv.products);
+    }
+
+    if(changed){
+        AST* new_body = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(body), NO_TYPE, 0);
+        for(int s=0; s<length; s++){
+            add_ast_child(new_body, get_ast_child(body, s));
+            for(int i=0; after[s] && i<get_ast_length(after[s]); i++){
+                add_ast_child(new_body, get_ast_child(after[s], i));
+            }
+        }
+        set_ast_child(repeat, 1, new_body);
+    }
+
+    free(after);
+    return prelude;
+}
+
+static AST* reduce_stmt_list(AST* list){
+    if(!list) return NULL;
+
+    AST* new_list = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(list), NO_TYPE, 0);
+
+    for(int s=0; s<get_ast_length(list); s++){
+        AST* stmt = get_ast_child(list, s);
+        NodeKind kind = get_ast_kind(stmt);
+
+        if(kind == IF_NODE || kind == REPEAT_NODE){
+            for(int i=1; i<get_ast_length(stmt); i++){
+                set_ast_child(stmt, i, reduce_stmt_list(get_ast_child(stmt, i)));
+            }
+        }
+
+        if(kind == REPEAT_NODE){
+            AST* prelude = reduce_loop(stmt);
+            for(int i=0; i<get_ast_length(prelude); i++){
+                add_ast_child(new_list, get_ast_child(prelude, i));
+            }
+        }
+        add_ast_child(new_list, stmt);
+    }
+
+    return new_list;
+}
+
+
+// Constant operands ----------------------------------------------------------
+
+// Magic number and shift for a signed division by d, 2 <= |d| < 2^31
+// (Hacker's Delight, figure 10-1).
+static void div_magic(int d, int* magic, int* shift){
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d < 0 ? 0u - (unsigned) d : (unsigned) d;
+    unsigned t = two31 + ((unsigned) d >> 31);
+    unsigned anc = t - 1 - t%ad;
+    unsigned q1 = two31/anc, r1 = two31 - q1*anc;
+    unsigned q2 = two31/ad,  r2 = two31 - q2*ad;
+    unsigned delta;
+    int p = 31;
+
+    do{
+        p++;
+        q1 = 2*q1; r1 = 2*r1;
+        if(r1 >= anc){ q1++; r1 -= anc; }
+        q2 = 2*q2; r2 = 2*r2;
+        if(r2 >= ad){ q2++; r2 -= ad; }
+        delta = ad - r2;
+    } while(q1 < delta || (q1 == delta && r1 == 0));
+
+    *magic = (int) (q2 + 1);
+    if(d < 0) *magic = -*magic;
+    *shift = p - 32;
+}
+
+static int log2_exact(int k){
+    for(int s=1; s<31; s++){
+        if(k == 1<<s) return s;
+    }
+    return 0;
+}
+
+static AST* new_int(int line, int value){
+    return new_ast(INT_VAL_NODE, NULL, line, INT_TYPE, value);
+}
+
+static AST* lower_times(AST* ast){
+    AST* l = get_ast_child(ast, 0);
+    AST* r = get_ast_child(ast, 1);
+    if(get_ast_kind(l) == INT_VAL_NODE){
+        AST* t = l; l = r; r = t;
+    }
+    if(get_ast_kind(r) != INT_VAL_NODE) return ast;
+
+    int k = get_ast_data(r);
+    int line = get_ast_line(ast);
+    if(k == 1) return l;
+    if(k == 0 && !may_trap(l)) return new_int(line, 0);
+
+    int s = log2_exact(k);
+    if(s) return new_ast_subtree(SHL_NODE, NULL, line, INT_TYPE, 2, l, new_int(line, s));
+    return ast;
+}
+
+static AST* lower_over(AST* ast){
+    AST* l = get_ast_child(ast, 0);
+    AST* r = get_ast_child(ast, 1);
+    if(get_ast_kind(r) != INT_VAL_NODE) return ast;
+
+    int d = get_ast_data(r);
+    if(d == 1) return l;
+    if(d == 0 || d == -1 || d == (int) 0x80000000u) return ast;
+
+    int magic, shift;
+    div_magic(d, &magic, &shift);
+    int line = get_ast_line(ast);
+    AST* div = new_ast(DIV_CONST_NODE, NULL, line, INT_TYPE, d);
+    add_ast_child(div, l);
+    add_ast_child(div, new_int(line, magic));
+    add_ast_child(div, new_int(line, shift));
+    return div;
+}
+
+static AST* lower(AST* ast){
+    for(int i=0; i<get_ast_length(ast); i++){
+        AST* child = get_ast_child(ast, i);
+        if(child) set_ast_child(ast, i, lower(child));
+    }
+
+    if(get_ast_type(ast) != INT_TYPE) return ast;
+    switch(get_ast_kind(ast)){
+        case TIMES_NODE: return lower_times(ast);
+        case OVER_NODE:  return lower_over(ast);
+        default:         return ast;
+    }
+}
+
+AST* reduce_strength(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    set_ast_child(ast, 1, reduce_stmt_list(get_ast_child(ast, 1)));
+    set_ast_child(ast, 1, lower(get_ast_child(ast, 1)));
+    return ast;
+}
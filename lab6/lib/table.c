@@ -112,6 +112,18 @@ int add_table_var(VarTable* var_table, AST* ast){
     return var_table->table_length-1;
 }
 
+// A declaration keeps its index in the table as data.
+void set_table_vars(VarTable* var_table, AST* var_decl_list){
+    CHECK_PTR(var_table);
+    CHECK_PTR(var_decl_list);
+    for(int i=0; i<get_ast_length(var_decl_list); i++){
+        AST* var_decl = get_ast_child(var_decl_list, i);
+        int idx = get_ast_data(var_decl);
+        CHECK_BOUNDS(idx, var_table->table_length);
+        var_table->table[idx] = var_decl;
+    }
+}
+
 
 // Output
 void print_var_table(VarTable* var_table){
@@ -42,6 +42,7 @@ void free_var_table(VarTable* var_table);
 
 // Modify
 int add_table_var(VarTable* var_table, AST* ast);
+void set_table_vars(VarTable* var_table, AST* var_decl_list); // After compact_ast moved them
 
 // Output
 void print_var_table(VarTable* var_table);
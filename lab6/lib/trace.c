@@ -0,0 +1,77 @@
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "trace.h"
+
+TraceRecord* trace_ring = NULL;
+unsigned long long trace_steps = 0;
+unsigned long long trace_time = 0;
+
+static const int crash_signals[] = {SIGSEGV, SIGFPE, SIGBUS, SIGABRT};
+
+static void write_all(int fd, const void* data, size_t size){
+    const char* bytes = data;
+    while(size > 0){
+        ssize_t written = write(fd, bytes, size);
+        if(written <= 0) return;
+        bytes += written;
+        size -= written;
+    }
+}
+
+void dump_trace(){
+    if(!trace_ring) return;
+    int fd = open(TRACE_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) return;
+
+    unsigned long long count = trace_steps < TRACE_RING_SIZE ? trace_steps : TRACE_RING_SIZE;
+    TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord), trace_steps, count};
+    write_all(fd, &header, sizeof(header));
+
+    // Oldest first: from the next slot to overwrite up to the end, then the start
+    unsigned long long first = (trace_steps - count) & (TRACE_RING_SIZE-1);
+    unsigned long long head = count < TRACE_RING_SIZE - first ? count : TRACE_RING_SIZE - first;
+    write_all(fd, &trace_ring[first], head*sizeof(TraceRecord));
+    write_all(fd, trace_ring, (count - head)*sizeof(TraceRecord));
+    close(fd);
+}
+
+static void dump_trace_at_exit(){
+    dump_trace();
+    free(trace_ring);
+    trace_ring = NULL;
+}
+
+// Dumps, then lets the signal end the process as it would have. Runs on its
+// own stack, the crash may come from running out of it.
+static void dump_trace_on_crash(int sig){
+    dump_trace();
+    trace_ring = NULL; // Once
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void init_trace(){
+    if(trace_ring) return;
+    trace_ring = malloc(TRACE_RING_SIZE*sizeof(TraceRecord));
+    CHECK_PTR_MSG(trace_ring, "Could not allocate memory");
+    trace_steps = 0;
+
+    atexit(dump_trace_at_exit);
+
+    static char crash_stack[TRACE_CRASH_STACK_SIZE];
+    stack_t alt = {crash_stack, 0, sizeof(crash_stack)};
+    sigaltstack(&alt, NULL);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = dump_trace_on_crash;
+    action.sa_flags = SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for(size_t i=0; i<sizeof(crash_signals)/sizeof(crash_signals[0]); i++){
+        sigaction(crash_signals[i], &action, NULL);
+    }
+}
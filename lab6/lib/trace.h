@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "debug.h"
+#include "ast.h"
+#include "profile.h"
+
+// Execution trace (make trace) ----------------------
+// Every node the interpreter runs writes a fixed-size record to a ring in
+// memory, so only the last TRACE_RING_SIZE steps are kept. The ring goes to
+// TRACE_PATH when the program exits, runtime errors included, or when it
+// crashes (SIGSEGV, SIGFPE, SIGBUS, SIGABRT). tools/decode_trace.c prints it.
+// Reading the clock costs more than running most nodes, so it is read every
+// TRACE_CLOCK_STEPS steps and the records in between repeat the last time.
+//
+// File: a TraceHeader, then header.count records, oldest first.
+#define TRACE_RING_SIZE (1 << 22) // Records, power of two (64 MB)
+#define TRACE_PATH "trace.bin"
+#define TRACE_MAGIC "EZTRACE"
+#define TRACE_VERSION 1
+#define TRACE_CLOCK_STEPS 16 // Power of two
+#define TRACE_CRASH_STACK_SIZE (1 << 16)
+
+typedef struct {
+    char magic[8];              // TRACE_MAGIC
+    unsigned int version;       // TRACE_VERSION
+    unsigned int record_size;   // sizeof(TraceRecord)
+    unsigned long long steps;   // Run in total
+    unsigned long long count;   // Records in the file, the last steps
+} TraceHeader;
+
+typedef struct {
+    unsigned int id;            // Node
+    unsigned short kind;        // NodeKind
+    short sp;                   // Data stack pointer as the node starts
+    unsigned long long time;    // get_prof_clock(), at most TRACE_CLOCK_STEPS old
+} TraceRecord;
+
+extern TraceRecord* trace_ring;
+extern unsigned long long trace_steps;
+extern unsigned long long trace_time;
+
+// Create
+void init_trace(); // Before the run, sets up the dump at exit and crash
+
+// Modify
+static inline void trace_step(AST* ast, int sp){
+    if(!(trace_steps & (TRACE_CLOCK_STEPS-1))) trace_time = get_prof_clock();
+    TraceRecord* record = &trace_ring[trace_steps++ & (TRACE_RING_SIZE-1)];
+    record->id = get_ast_id(ast);
+    record->kind = get_ast_kind(ast);
+    record->sp = sp;
+    record->time = trace_time;
+}
+
+// Output
+void dump_trace(); // Only uses write(2), safe in a signal handler
+//----------------------------------------------------
+
+#endif // TRACE_H
@@ -0,0 +1,193 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "optimizer.h"
+
+// Loop unrolling
+// ----------------------------------------------------------------------------
+// A repeat counting v up (or down) by a constant, v written nowhere else,
+// until an invariant bound < v (or v < bound) runs a number of iterations
+// known on entry, the same TRIP_COUNT_NODE scev.c uses. With a factor F:
+//   $k := trip count
+//   if $k = 0 then <the loop>                      (v would wrap around)
+//   else
+//       $r := $k - $k / F * F
+//       if 0 < $r then repeat <body> $r := $r - 1 until $r < 1 end
+//       if F - 1 < $k then repeat <body> ... <body> until <cond> end
+//   end
+// The remainder runs first, after it the iterations left are a multiple of
+// F and the until check of the unrolled loop is only true at the very end.
+//
+// F is the biggest power of two, up to UNROLL_MAX_FACTOR, keeping the
+// unrolled body under UNROLL_BUDGET nodes; a loop that does not fit twice is
+// left alone. set_unroll_factor forces F for every loop (1 disables).
+
+#define UNROLL_BUDGET 64
+#define UNROLL_MAX_FACTOR 8
+
+extern VarTable *vt;
+
+static int forced_factor = 0;
+
+void set_unroll_factor(int factor){
+    forced_factor = factor;
+}
+
+static int reads_assigned(AST* expr, char* assigned){
+    if(get_ast_kind(expr) == VAR_USE_NODE) return assigned[(int) get_ast_data(expr)];
+    for(int i=0; i<get_ast_length(expr); i++){
+        if(reads_assigned(get_ast_child(expr, i), assigned)) return 1;
+    }
+    return 0;
+}
+
+static int get_factor(AST* body){
+    if(forced_factor) return forced_factor;
+
+    int size = get_ast_size(body);
+    int factor = 1;
+    while(2*factor <= UNROLL_MAX_FACTOR && 2*factor*size <= UNROLL_BUDGET) factor *= 2;
+    return factor;
+}
+
+// The counter step of the loop, 0 if the trip count is not known on entry.
+static int get_loop_step(AST* repeat, AST** start, AST** bound){
+    AST* cond = get_ast_child(repeat, 0);
+    AST* body = get_ast_child(repeat, 1);
+    if(get_ast_kind(cond) != LT_NODE) return 0;
+
+    int writes[MEM_SIZE] = {0};
+    char assigned[MEM_SIZE] = {0};
+    count_writes(repeat, writes);
+    mark_assigned(repeat, assigned);
+
+    for(int s=0; s<get_ast_length(body); s++){
+        int var, step;
+        if(!get_counter_step(get_ast_child(body, s), &var, &step) || writes[var] != 1) continue;
+
+        AST* l = get_ast_child(cond, 0);
+        AST* r = get_ast_child(cond, 1);
+        int l_is_var = get_ast_kind(l) == VAR_USE_NODE && (int) get_ast_data(l) == var;
+        int r_is_var = get_ast_kind(r) == VAR_USE_NODE && (int) get_ast_data(r) == var;
+
+        if(r_is_var && step > 0 && !reads_assigned(l, assigned) && !may_trap(l)){
+            *start = r;
+            *bound = l;
+            return step;
+        }
+        if(l_is_var && step < 0 && !reads_assigned(r, assigned) && !may_trap(r)){
+            *start = l;
+            *bound = r;
+            return step;
+        }
+    }
+    return 0;
+}
+
+static AST* new_int(int line, int x){
+    return new_ast(INT_VAL_NODE, NULL, line, INT_TYPE, x);
+}
+
+static AST* new_op(NodeKind kind, Type type, AST* a, AST* b, int line){
+    return new_ast_subtree(kind, NULL, line, type, 2, a, b);
+}
+
+static AST* new_list(int line){
+    return new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 0);
+}
+
+static void append_copy(AST* list, AST* stmts){
+    for(int i=0; i<get_ast_length(stmts); i++){
+        add_ast_child(list, copy_ast(get_ast_child(stmts, i)));
+    }
+}
+
+// Returns the statements replacing repeat, or NULL to keep it.
+static AST* unroll_loop(AST* repeat){
+    AST *start, *bound;
+    int step = get_loop_step(repeat, &start, &bound);
+    if(!step) return NULL;
+
+    AST* cond = get_ast_child(repeat, 0);
+    AST* body = get_ast_child(repeat, 1);
+    int factor = get_factor(body);
+    if(factor < 2 || get_var_table_length(vt) + 2 > MEM_SIZE) return NULL;
+
+    int line = get_ast_line(cond);
+    AST* k_var = new_temp_var(INT_TYPE);
+    AST* r_var = new_temp_var(INT_TYPE);
+
+    AST* trip = new_op(TRIP_COUNT_NODE, INT_TYPE, copy_ast(start), copy_ast(bound), line);
+    set_ast_data(trip, step);
+
+    // $r := $k - $k / F * F
+    AST* groups = new_op(TIMES_NODE, INT_TYPE,
+                         new_op(OVER_NODE, INT_TYPE, new_var_use(k_var, line), new_int(line, factor), line),
+                         new_int(line, factor), line);
+    AST* rest = new_op(MINUS_NODE, INT_TYPE, new_var_use(k_var, line), groups, line);
+
+    // if 0 < $r then repeat <body> $r := $r - 1 until $r < 1 end
+    AST* rest_body = new_list(line);
+    append_copy(rest_body, body);
+    add_ast_child(rest_body, new_assign(r_var, new_op(MINUS_NODE, INT_TYPE, new_var_use(r_var, line), new_int(line, 1), line)));
+    AST* rest_loop = new_ast_subtree(REPEAT_NODE, NULL, line, NO_TYPE, 2,
+                                     new_op(LT_NODE, BOOL_TYPE, new_var_use(r_var, line), new_int(line, 1), line), rest_body);
+    AST* rest_if = new_ast_subtree(IF_NODE, NULL, line, NO_TYPE, 2,
+                                   new_op(LT_NODE, BOOL_TYPE, new_int(line, 0), new_var_use(r_var, line), line),
+                                   new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 1, rest_loop));
+
+    // if F - 1 < $k then repeat <body> x F until <cond> end
+    AST* unrolled_body = new_list(line);
+    for(int i=0; i<factor; i++) append_copy(unrolled_body, body);
+    AST* unrolled = new_ast_subtree(REPEAT_NODE, NULL, get_ast_line(repeat), NO_TYPE, 2, copy_ast(cond), unrolled_body);
+    AST* unrolled_if = new_ast_subtree(IF_NODE, NULL, line, NO_TYPE, 2,
+                                       new_op(LT_NODE, BOOL_TYPE, new_int(line, factor-1), new_var_use(k_var, line), line),
+                                       new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 1, unrolled));
+
+    AST* counted = new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 3, new_assign(r_var, rest), rest_if, unrolled_if);
+    AST* no_trip = new_op(EQ_NODE, BOOL_TYPE, new_var_use(k_var, line), new_int(line, 0), line);
+
+    return new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 2,
+               new_assign(k_var, trip),
+               new_ast_subtree(IF_NODE, NULL, line, NO_TYPE, 3, no_trip,
+                               new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 1, repeat),
+                               counted));
+}
+
+static AST* unroll_stmt_list(AST* list){
+    if(!list) return NULL;
+
+    AST* new_list = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(list), NO_TYPE, 0);
+
+    for(int s=0; s<get_ast_length(list); s++){
+        AST* stmt = get_ast_child(list, s);
+        NodeKind kind = get_ast_kind(stmt);
+
+        if(kind == IF_NODE || kind == REPEAT_NODE){
+            for(int i=1; i<get_ast_length(stmt); i++){
+                set_ast_child(stmt, i, unroll_stmt_list(get_ast_child(stmt, i)));
+            }
+        }
+
+        AST* unrolled = kind == REPEAT_NODE ? unroll_loop(stmt) : NULL;
+        if(!unrolled){
+            add_ast_child(new_list, stmt);
+            continue;
+        }
+        for(int i=0; i<get_ast_length(unrolled); i++){
+            add_ast_child(new_list, get_ast_child(unrolled, i));
+        }
+    }
+
+    return new_list;
+}
+
+AST* unroll_loops(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    set_ast_child(ast, 1, unroll_stmt_list(get_ast_child(ast, 1)));
+    return ast;
+}
@@ -0,0 +1,154 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "interpreter.h"
+#include "optimizer.h"
+
+// Loop unswitching
+// ----------------------------------------------------------------------------
+// An if inside a repeat whose condition reads no variable written by the loop
+// takes the same branch on every iteration. The loop is turned inside out:
+//   repeat ... if c then A else B end ... until e
+// becomes
+//   if c then repeat ... A ... until e else repeat ... B ... until e end
+// Every if of the loop testing the same condition is resolved in both copies,
+// and each copy is unswitched again on its next invariant if. The condition
+// is evaluated once before the loop instead of on the first visit of the if:
+// only ifs that run on every iteration are candidates, those in the body and
+// in the bodies of nested repeats but not in a branch, which may never run.
+// Once the loop is unswitched, the branch taken is part of the body and its
+// own ifs become candidates. Conditions that may trap are left alone.
+//
+// Each unswitch copies the whole loop. A loop bigger than
+// UNSWITCH_MAX_LOOP_SIZE nodes is never copied, and the program may only grow
+// by UNSWITCH_GROWTH_PERCENT of its size (plus one loop of the maximum size,
+// so small programs are not stuck).
+
+#define UNSWITCH_MAX_LOOP_SIZE 256
+#define UNSWITCH_GROWTH_PERCENT 50
+
+static int budget; // Nodes that can still be added
+
+static AST* unswitch_stmt_list(AST* list);
+
+static int is_invariant(AST* expr, char* assigned){
+    if(get_ast_kind(expr) == VAR_USE_NODE) return !assigned[(int) get_ast_data(expr)];
+
+    for(int i=0; i<get_ast_length(expr); i++){
+        if(!is_invariant(get_ast_child(expr, i), assigned)) return 0;
+    }
+    return 1;
+}
+
+// Returns the condition of the first if under list worth unswitching on,
+// among those run every time list is.
+static AST* find_cond(AST* list, char* assigned){
+    for(int s=0; s<get_ast_length(list); s++){
+        AST* stmt = get_ast_child(list, s);
+        NodeKind kind = get_ast_kind(stmt);
+        if(kind != IF_NODE && kind != REPEAT_NODE) continue;
+
+        AST* cond = get_ast_child(stmt, 0);
+        if(kind == IF_NODE && !is_const_ast(cond) && is_invariant(cond, assigned) && !may_trap(cond)){
+            return cond;
+        }
+
+        if(kind == REPEAT_NODE){
+            AST* found = find_cond(get_ast_child(stmt, 1), assigned);
+            if(found) return found;
+        }
+    }
+    return NULL;
+}
+
+// Copy of list where every if testing cond keeps only the branch it takes
+// when cond is taken.
+static AST* specialize(AST* list, AST* cond, int taken){
+    AST* new_list = new_ast_subtree(STMT_LIST_NODE, NULL, get_ast_line(list), NO_TYPE, 0);
+
+    for(int s=0; s<get_ast_length(list); s++){
+        AST* stmt = get_ast_child(list, s);
+        NodeKind kind = get_ast_kind(stmt);
+
+        if(kind == IF_NODE && is_same_ast(get_ast_child(stmt, 0), cond)){
+            AST* branch = get_ast_child(stmt, taken ? 1 : 2);
+            if(!branch) continue;
+
+            AST* spliced = specialize(branch, cond, taken);
+            for(int i=0; i<get_ast_length(spliced); i++){
+                add_ast_child(new_list, get_ast_child(spliced, i));
+            }
+        }
+        else if(kind == IF_NODE || kind == REPEAT_NODE){
+            AST* copy = new_ast(kind, NULL, get_ast_line(stmt), get_ast_type(stmt), get_ast_data(stmt));
+            add_ast_child(copy, copy_ast(get_ast_child(stmt, 0)));
+            for(int i=1; i<get_ast_length(stmt); i++){
+                add_ast_child(copy, specialize(get_ast_child(stmt, i), cond, taken));
+            }
+            add_ast_child(new_list, copy);
+        }
+        else{
+            add_ast_child(new_list, copy_ast(stmt));
+        }
+    }
+
+    return new_list;
+}
+
+static AST* new_loop(AST* repeat, AST* body){
+    return new_ast_subtree(REPEAT_NODE, NULL, get_ast_line(repeat), NO_TYPE, 2,
+                           copy_ast(get_ast_child(repeat, 0)), body);
+}
+
+// Returns the statement that replaces repeat.
+static AST* unswitch_loop(AST* repeat){
+    char assigned[MEM_SIZE] = {0};
+    mark_assigned(repeat, assigned);
+
+    AST* body = get_ast_child(repeat, 1);
+    AST* cond = find_cond(body, assigned);
+    if(!cond) return repeat;
+
+    int size = get_ast_size(repeat);
+    if(size > UNSWITCH_MAX_LOOP_SIZE || size > budget) return repeat;
+    budget -= size;
+
+    int line = get_ast_line(cond);
+    AST* then_loop = unswitch_loop(new_loop(repeat, specialize(body, cond, 1)));
+    AST* else_loop = unswitch_loop(new_loop(repeat, specialize(body, cond, 0)));
+
+    return new_ast_subtree(IF_NODE, NULL, line, NO_TYPE, 3, copy_ast(cond),
+                           new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 1, then_loop),
+                           new_ast_subtree(STMT_LIST_NODE, NULL, line, NO_TYPE, 1, else_loop));
+}
+
+static AST* unswitch_stmt_list(AST* list){
+    if(!list) return NULL;
+
+    for(int s=0; s<get_ast_length(list); s++){
+        AST* stmt = get_ast_child(list, s);
+        NodeKind kind = get_ast_kind(stmt);
+
+        // Inner loops first: an unswitched inner loop is an if the outer
+        // one may be unswitched on in turn.
+        if(kind == IF_NODE || kind == REPEAT_NODE){
+            for(int i=1; i<get_ast_length(stmt); i++){
+                set_ast_child(stmt, i, unswitch_stmt_list(get_ast_child(stmt, i)));
+            }
+        }
+
+        if(kind == REPEAT_NODE) set_ast_child(list, s, unswitch_loop(stmt));
+    }
+
+    return list;
+}
+
+AST* unswitch_loops(AST* ast){
+    CHECK_PTR(ast);
+    if(get_ast_kind(ast) != PROGRAM_NODE) return ast;
+
+    budget = UNSWITCH_MAX_LOOP_SIZE + get_ast_size(ast)*UNSWITCH_GROWTH_PERCENT/100;
+    set_ast_child(ast, 1, unswitch_stmt_list(get_ast_child(ast, 1)));
+    return ast;
+}
@@ -4,18 +4,26 @@
 %define parse.lac full      // Enable LAC to improve syntax error handling.
 
 %{
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "lib/debug.h"
 #include "lib/type.h"
 #include "lib/table.h"
 #include "lib/ast.h"
+#include "lib/input.h"
 #include "lib/interpreter.h"
+#include "lib/optimizer.h"
+#include "lib/output.h"
+#include "lib/cover.h"
+#include "lib/profile.h"
+#include "lib/sample.h"
 
 int yylex(void);
 void yyerror(char const *s);
-char* yytext;
-int yylineno;
+extern char* yytext;
+extern int yylineno;
+extern FILE* yyin;
 
 char last_id[VARIABLE_MAX_SIZE+1];
 
@@ -24,11 +32,29 @@ VarTable* vt = NULL;
 StrTable* st = NULL;
 AST* root_ast = NULL;
 
+char* program_path = NULL; // NULL: program comes from stdin
+char* input_path = NULL;   // NULL: data comes from stdin
+char* record_path = NULL;
+char* replay_path = NULL;
+char* dot_path = NULL;     // NULL: no dot output
+int dot_depth = 0;
+char* profile_dot_path = NULL;
+char* profile_json_path = NULL;
+int profile_report = 0;
+char* sample_path = NULL;
+char* cover_path = NULL;
+int batch_input = 0;
+int share_nodes = 0;
+
+void parse_args(int argc, char* argv[]);
+void usage(char* prog);
+
 void decl_var(AST* var_decl);
 void check_var(AST* var_use);
 void check_bool(AST* cond_stmt);
 Type eval_expr(AST* expr);
 Type eval_operation(AST* operation);
+Type conv_type(NodeKind conv);
 
 // Semantic error
 void already_declared(int line, char* name, int prev_line);
@@ -92,11 +118,11 @@ stmt:
 
 if_stmt:
     IF expr THEN stmt_list END                { $$=new_ast_subtree(IF_NODE, NULL, get_ast_line($2), NO_TYPE, 2, $2, $4); check_bool($$); }
-  | IF expr THEN stmt_list ELSE stmt_list END { $$=new_ast_subtree(IF_NODE, NULL, get_ast_line($2), NO_TYPE, 2, $2, $4, $6); check_bool($$); }
+  | IF expr THEN stmt_list ELSE stmt_list END { $$=new_ast_subtree(IF_NODE, NULL, get_ast_line($2), NO_TYPE, 3, $2, $4, $6); check_bool($$); }
 ;
 
 repeat_stmt:
-    REPEAT stmt_list UNTIL expr { $$=new_ast_subtree(REPEAT_NODE, NULL, get_ast_line($2), NO_TYPE, 2, $4, $2); check_bool($$); }
+    REPEAT stmt_list UNTIL expr { $$=new_ast_subtree(REPEAT_NODE, NULL, get_ast_line($4), NO_TYPE, 2, $4, $2); check_bool($$); }
 ;
 
 read_stmt:
@@ -154,24 +180,145 @@ constant_expr:
 %%
 
 
-int main(void) {
+int main(int argc, char* argv[]) {
+
+    parse_args(argc, argv);
 
     st = new_str_table();
     vt = new_var_table();
 
+    if(program_path){
+        yyin = fopen(program_path, "r");
+        if(!yyin){
+            printf("ERROR: could not open program file '%s'.\n", program_path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
     yyparse();
-    stdin = fopen(ctermid(NULL), "r");
+
+    // Without a program file stdin held the source, so ask the terminal.
+    if(replay_path){
+        init_input_replay(replay_path);
+    }
+    else if(batch_input){
+        init_input_batch(input_path);
+    }
+    else{
+        stdin = fopen(ctermid(NULL), "r");
+        init_input_tty();
+    }
+    if(record_path) set_input_record(record_path);
     /* print_str_table(st); */
     /* print_var_table(vt); */
+    root_ast = optimize_ast(root_ast);
+    if(share_nodes){
+        root_ast = share_ast(root_ast);
+        set_table_vars(vt, get_ast_child(root_ast, 0));
+    }
+    if(profile_report || profile_dot_path || profile_json_path) init_profile();
+    if(profile_report) set_profile_report(stderr);
+    if(cover_path) init_cover(cover_path, program_path);
+    if(sample_path) start_sampling(sample_path);
     run_ast(root_ast);
-    gen_ast_dot(root_ast);
+    stop_sampling();
+    report_profile(root_ast);
+    report_cover(root_ast);
+    if(dot_path) gen_ast_dot(root_ast, dot_path, dot_depth);
+    if(profile_dot_path) gen_profile_dot(root_ast, profile_dot_path, dot_depth);
+    if(profile_json_path) gen_profile_json(root_ast, profile_json_path);
+    free_profile();
+    free_input();
     free_str_table(st);
     free_var_table(vt);
+    free_all_ast();
 
 
     return 0;
 }
 
+void parse_args(int argc, char* argv[]){
+
+    static struct option long_opts[] = {
+        {"async-output", no_argument,       NULL, 'a'},
+        {"input",        required_argument, NULL, 'i'},
+        {"optimize",     required_argument, NULL, 'O'},
+        {"unroll",       required_argument, NULL, 'u'},
+        {"ssa",          required_argument, NULL, 'S'},
+        {"share",        no_argument,       NULL, 's'},
+        {"record",       required_argument, NULL, 'R'},
+        {"replay",       required_argument, NULL, 'P'},
+        {"dot",          required_argument, NULL, 'd'},
+        {"dot-depth",    required_argument, NULL, 'D'},
+        {"profile",      no_argument,       NULL, 'p'},
+        {"profile-dot",  required_argument, NULL, 'G'},
+        {"profile-json", required_argument, NULL, 'J'},
+        {"sample",       required_argument, NULL, 'X'},
+        {"coverage",     required_argument, NULL, 'C'},
+        {"help",         no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int opt;
+    while((opt = getopt_long(argc, argv, "ai:O:u:sd:ph", long_opts, NULL)) != -1){
+        switch(opt){
+            case 'a': set_output_async(1); break;
+            case 'i': input_path = optarg; break;
+            case 'O': set_opt_level(atoi(optarg)); break;
+            case 'u': set_unroll_factor(atoi(optarg)); break;
+            case 'S': set_ssa_dump(optarg); break;
+            case 's': share_nodes = 1; break;
+            case 'R': record_path = optarg; break;
+            case 'P': replay_path = optarg; break;
+            case 'd': dot_path = optarg; break;
+            case 'D': dot_depth = atoi(optarg); break;
+            case 'p': profile_report = 1; break;
+            case 'G': profile_dot_path = optarg; break;
+            case 'J': profile_json_path = optarg; break;
+            case 'X': sample_path = optarg; break;
+            case 'C': cover_path = optarg; break;
+            case 'h': usage(argv[0]); exit(0);
+            default:  usage(argv[0]); exit(EXIT_FAILURE);
+        }
+    }
+
+    if(optind < argc) program_path = argv[optind++];
+    if(optind < argc){
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if(cover_path && !program_path){
+        printf("ERROR: --coverage needs the program as a file, its lines are named by path.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Only prompt at the terminal when nothing says where the data is.
+    batch_input = program_path || input_path;
+}
+
+void usage(char* prog){
+    printf("usage: %s [options] [program.ezl]\n", prog);
+    printf("Without a program file the source is read from stdin and each read\n");
+    printf("prompts at the terminal. With a program file, or with -i, reads take\n");
+    printf("whitespace separated values from stdin (or FILE) without prompting.\n\n");
+    printf("  -a, --async-output  write program output from a separate thread\n");
+    printf("  -i, --input FILE    read program input from FILE, without prompts\n");
+    printf("  -O, --optimize N    optimization level, 0 disables the optimizer (default %d)\n", OPT_LEVEL_DEFAULT);
+    printf("  -u, --unroll N      unroll counting loops N times, 1 disables (default: by body size)\n");
+    printf("      --ssa FILE      write the SSA form of the program to FILE (-O %d runs it)\n", OPT_LEVEL_SSA);
+    printf("  -s, --share         run with identical expressions merged into one node\n");
+    printf("      --record FILE   save every value read by the program in FILE\n");
+    printf("      --replay FILE   take the values read from a --record FILE\n");
+    printf("  -d, --dot FILE      write the AST, as run, to FILE in dot format\n");
+    printf("      --dot-depth N   collapse what is deeper than N in the dot output\n");
+    printf("  -p, --profile       run instrumented, report counts and cycles by line on stderr\n");
+    printf("      --profile-dot FILE   run instrumented, write the AST colored by time to FILE\n");
+    printf("      --profile-json FILE  run instrumented, write counts and cycles by node to FILE\n");
+    printf("      --sample FILE   sample the running line, write folded stacks to FILE for flamegraph.pl\n");
+    printf("      --coverage FILE write the lines run to FILE as an lcov tracefile, for genhtml\n");
+    printf("  -h, --help          show this message\n");
+}
+
 void decl_var(AST* var_decl){
 
     AST* found_ast = lookup_table_var(vt, var_decl);
@@ -306,8 +453,8 @@ Type eval_operation(AST* operation){
     set_ast_type(operation, unif.type);
 
     // Adiciona nós de conversão quando necessário
-    l_ast = (unif.lnk == NONE) ? l_ast : new_ast_subtree(unif.lnk, get_ast_name(l_ast), get_ast_line(l_ast), get_ast_type(l_ast), 1, l_ast);
-    r_ast = (unif.rnk == NONE) ? r_ast : new_ast_subtree(unif.rnk, get_ast_name(r_ast), get_ast_line(r_ast), get_ast_type(r_ast), 1, r_ast);
+    l_ast = (unif.lnk == NONE) ? l_ast : new_ast_subtree(unif.lnk, get_ast_name(l_ast), get_ast_line(l_ast), conv_type(unif.lnk), 1, l_ast);
+    r_ast = (unif.rnk == NONE) ? r_ast : new_ast_subtree(unif.rnk, get_ast_name(r_ast), get_ast_line(r_ast), conv_type(unif.rnk), 1, r_ast);
 
 
     set_ast_child(operation, 0, l_ast);
@@ -316,6 +463,20 @@ Type eval_operation(AST* operation){
     return unif.type;
 }
 
+// O interpretador escolhe a operação pelo tipo do operando, então um nó de
+// conversão tem o tipo de destino.
+Type conv_type(NodeKind conv){
+    switch(conv){
+        case B2I_NODE: return INT_TYPE;
+        case B2R_NODE:
+        case I2R_NODE: return REAL_TYPE;
+        case B2S_NODE:
+        case I2S_NODE:
+        case R2S_NODE: return STR_TYPE;
+        default: SWITCH_ERROR(conv);
+    }
+}
+
 
 // Semantic error
 void already_declared(int line, char* name, int prev_line){
@@ -0,0 +1,58 @@
+// Prints a trace written by a `make trace` build (see lib/trace.h), one step
+// per line: step number, node id, node kind, stack pointer and the cycles
+// since the step before (0 between clock reads, see TRACE_CLOCK_STEPS).
+//   gcc -Wall tools/decode_trace.c lib/ast.c lib/arena.c lib/type.c -o decode_trace.bin
+//   ./decode_trace.bin [-n LAST] [trace.bin]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../lib/trace.h"
+
+int main(int argc, char* argv[]){
+
+    unsigned long long last = 0; // 0: every step in the file
+    int opt;
+    while((opt = getopt(argc, argv, "n:")) != -1){
+        switch(opt){
+            case 'n': last = strtoull(optarg, NULL, 10); break;
+            default:
+                printf("usage: %s [-n LAST] [%s]\n", argv[0], TRACE_PATH);
+                exit(EXIT_FAILURE);
+        }
+    }
+    char* path = optind < argc ? argv[optind] : TRACE_PATH;
+
+    FILE* file = fopen(path, "rb");
+    if(!file){
+        printf("ERROR: could not open trace file '%s'.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    TraceHeader header;
+    if(fread(&header, sizeof(header), 1, file) != 1 || strcmp(header.magic, TRACE_MAGIC)
+       || header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)){
+        printf("ERROR: '%s' is not a version %d trace.\n", path, TRACE_VERSION);
+        exit(EXIT_FAILURE);
+    }
+
+    unsigned long long skip = last && last < header.count ? header.count - last : 0;
+    fseek(file, skip*sizeof(TraceRecord), SEEK_CUR);
+    printf("# %llu steps run, %llu kept, from step %llu\n", header.steps, header.count - skip,
+           header.steps - header.count + skip);
+    printf("# %12s %8s %-16s %4s %10s\n", "step", "node", "kind", "sp", "cycles");
+
+    unsigned long long step = header.steps - header.count + skip;
+    unsigned long long time = 0;
+    TraceRecord record;
+    while(fread(&record, sizeof(record), 1, file) == 1){
+        char* kind = record.kind < NONE ? get_kind_str(record.kind) : "?";
+        printf("  %12llu %8u %-16s %4d %10llu\n", step++, record.id, kind, record.sp,
+               time ? record.time - time : 0);
+        time = record.time;
+    }
+
+    fclose(file);
+    return 0;
+}